@@ -0,0 +1,176 @@
+#include "../src/ECS/ECS.h"
+#include "../src/Components/TransformComponent.h"
+#include "../src/Components/RigidBodyComponent.h"
+#include "../src/Components/SpriteComponent.h"
+#include "../src/Components/BoxColliderComponent.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// the level scenes scaled up 10x, iterated with plain pools and with the transform and sprite pools packed by an archetype,
+// the way the game sets them up: the sprites ordered by z index and the pools scrambled by projectiles spawning and dying
+// the registry logs to stdout, the results are printed to stderr
+
+const int SCALE = 10;
+const int NUM_FRAMES = 200;
+
+struct Scene {
+    std::string name;
+    int numTiles = 0;
+    int numEntities = 0;
+};
+
+// the tiles of the level map and the entities of the level script, without running lua
+Scene LoadScene(const std::string& scriptFile) {
+    Scene scene;
+    scene.name = scriptFile;
+
+    std::ifstream script(scriptFile);
+    std::string line;
+    std::string mapFile;
+    while (std::getline(script, line)) {
+        if (line.find("components = {") != std::string::npos) {
+            scene.numEntities++;
+        }
+        size_t mapFileStart = line.find("map_file = \"");
+        if (mapFileStart != std::string::npos) {
+            mapFileStart += std::string("map_file = \"").size();
+            mapFile = line.substr(mapFileStart, line.find('"', mapFileStart) - mapFileStart);
+        }
+    }
+
+    std::ifstream map(mapFile);
+    while (std::getline(map, line)) {
+        for (char c : line) {
+            if (c == ',') {
+                scene.numTiles++;
+            }
+        }
+        if (!line.empty()) {
+            scene.numTiles++;
+        }
+    }
+    return scene;
+}
+
+void Populate(Registry& registry, const Scene& scene) {
+    registry.SetComponentOrder<SpriteComponent>([](const SpriteComponent& a, const SpriteComponent& b) {
+        if (a.data->zIndex != b.data->zIndex) {
+            return a.data->zIndex < b.data->zIndex;
+        }
+        return a.data < b.data;
+    });
+
+    Prefab tilePrefab;
+    tilePrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(2.0, 2.0), 0.0);
+    tilePrefab.AddComponent<SpriteComponent>("tilemap-texture-day", 32, 32, 0);
+
+    Prefab entityPrefab;
+    entityPrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(1.0, 1.0), 0.0);
+    entityPrefab.AddComponent<RigidBodyComponent>(glm::vec2(10.0, 0.0));
+    entityPrefab.AddComponent<SpriteComponent>("tank-tiger-right-texture", 32, 32, 2);
+    entityPrefab.AddComponent<BoxColliderComponent>(32, 32);
+
+    Prefab projectilePrefab;
+    projectilePrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(1.0, 1.0), 0.0);
+    projectilePrefab.AddComponent<RigidBodyComponent>(glm::vec2(0.0, 100.0));
+    projectilePrefab.AddComponent<SpriteComponent>("bullet-texture", 4, 4, 4);
+    projectilePrefab.AddComponent<BoxColliderComponent>(4, 4);
+
+    std::mt19937 random(42);
+    std::vector<Entity> projectiles;
+    for (int copy = 0; copy < SCALE; copy++) {
+        registry.Instantiate(tilePrefab, scene.numTiles, [](Entity tile, int index) {
+            tile.GetComponent<TransformComponent>().position = glm::vec2(index % 40 * 64, index / 40 * 64);
+        });
+        registry.Instantiate(entityPrefab, scene.numEntities, [&random](Entity entity, int) {
+            entity.GetComponent<TransformComponent>().position = glm::vec2(random() % 2560, random() % 1920);
+        });
+
+        // the projectiles of a few seconds of shooting, most of them die in a random order
+        auto newProjectiles = registry.Instantiate(projectilePrefab, scene.numEntities * 4);
+        projectiles.insert(projectiles.end(), newProjectiles.begin(), newProjectiles.end());
+        std::shuffle(projectiles.begin(), projectiles.end(), random);
+        while (projectiles.size() > static_cast<size_t>(scene.numEntities)) {
+            projectiles.back().Kill();
+            projectiles.pop_back();
+        }
+        registry.Update();
+    }
+
+    // the game defragments in the idle time of every frame
+    for (int frame = 0; frame < 10; frame++) {
+        registry.Defragment(1000);
+    }
+}
+
+template <typename TFunc>
+double MicrosecsPerFrame(TFunc&& func) {
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        func();
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / NUM_FRAMES;
+}
+
+struct Timings {
+    double render;
+    double collision;
+    double movement;
+};
+
+Timings Measure(Registry& registry) {
+    Timings timings;
+    volatile double sink = 0.0;
+
+    timings.render = MicrosecsPerFrame([&]() {
+        double sum = 0.0;
+        registry.View<const TransformComponent, const SpriteComponent>().Each([&sum](Entity, const TransformComponent& transform, const SpriteComponent& sprite) {
+            sum += transform.position.x * transform.scale.x + sprite.data->zIndex + sprite.srcRect.w;
+        });
+        sink = sink + sum;
+    });
+    timings.collision = MicrosecsPerFrame([&]() {
+        double sum = 0.0;
+        registry.View<const TransformComponent, const BoxColliderComponent>().Each([&sum](Entity, const TransformComponent& transform, const BoxColliderComponent& collider) {
+            sum += transform.position.x + collider.offset.x + collider.width;
+        });
+        sink = sink + sum;
+    });
+    timings.movement = MicrosecsPerFrame([&]() {
+        registry.View<TransformComponent, const RigidBodyComponent>().Each([](Entity, TransformComponent& transform, const RigidBodyComponent& rigidBody) {
+            transform.position += rigidBody.velocity * 0.016f;
+        });
+    });
+    return timings;
+}
+
+// only one registry can be alive at a time, each backend gets its own in turn
+Timings Run(const Scene& scene, bool isPacked) {
+    Registry registry;
+    if (isPacked) {
+        registry.AddArchetype<TransformComponent, SpriteComponent>();
+    }
+    Populate(registry, scene);
+    return Measure(registry);
+}
+
+int main() {
+    for (const auto& scriptFile : {"./assets/scripts/Level1.lua", "./assets/scripts/Level2.lua"}) {
+        Scene scene = LoadScene(scriptFile);
+        Timings plain = Run(scene, false);
+        Timings packed = Run(scene, true);
+
+        fprintf(stderr, "Archetype benchmark, %s x%d: %d tiles, %d entities and projectiles\n", scene.name.c_str(), SCALE, scene.numTiles * SCALE, scene.numEntities * 2 * SCALE);
+        fprintf(stderr, "                         plain pools   archetype\n");
+        fprintf(stderr, "    render view:         %8.1f us  %8.1f us\n", plain.render, packed.render);
+        fprintf(stderr, "    collision view:      %8.1f us  %8.1f us\n", plain.collision, packed.collision);
+        fprintf(stderr, "    movement view:       %8.1f us  %8.1f us\n", plain.movement, packed.movement);
+    }
+    return 0;
+}
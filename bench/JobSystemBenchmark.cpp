@@ -0,0 +1,55 @@
+#include "../src/ECS/ECS.h"
+#include "../src/JobSystem/JobSystem.h"
+#include "../src/Components/TransformComponent.h"
+#include "../src/Components/RigidBodyComponent.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+// the movement of 100k entities split in chunks across 1, 2, 4, 8 and 16 threads, like MovementSystem::Update
+// the registry logs to stdout, the results are printed to stderr
+
+const int NUM_ENTITIES = 100000;
+const int NUM_FRAMES = 100;
+const int GRAIN = 1024;
+
+int main() {
+    Registry registry;
+
+    Prefab movingPrefab;
+    movingPrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(1.0, 1.0), 0.0);
+    movingPrefab.AddComponent<RigidBodyComponent>(glm::vec2(10.0, 20.0));
+    registry.Instantiate(movingPrefab, NUM_ENTITIES, [](Entity entity, int index) {
+        entity.GetComponent<TransformComponent>().position = glm::vec2(index % 1000, index / 1000);
+    });
+    registry.Update();
+
+    fprintf(stderr, "Job system benchmark, %d moving entities, %u hardware threads\n", NUM_ENTITIES, std::thread::hardware_concurrency());
+
+    double singleThreadMillisecs = 0.0;
+    for (int numThreads : {1, 2, 4, 8, 16}) {
+        // the main thread takes part in the work, the others are workers
+        JobSystem jobSystem(numThreads - 1);
+        double deltaTime = 1.0 / 60.0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < NUM_FRAMES; frame++) {
+            auto view = registry.View<TransformComponent, const RigidBodyComponent>();
+            jobSystem.ParallelFor(view.SizeHint(), GRAIN, [&view, deltaTime](int begin, int end) {
+                view.EachInRange(begin, end, [deltaTime](Entity, TransformComponent& transform, const RigidBodyComponent& rigidBody) {
+                    transform.position.x += rigidBody.velocity.x * deltaTime;
+                    transform.position.y += rigidBody.velocity.y * deltaTime;
+                    transform.rotation = glm::atan(rigidBody.velocity.y, rigidBody.velocity.x);
+                });
+            });
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        double millisecs = elapsed.count() / NUM_FRAMES;
+        if (numThreads == 1) {
+            singleThreadMillisecs = millisecs;
+        }
+        fprintf(stderr, "    %2d threads: %7.3f ms/frame, %5.2fx\n", numThreads, millisecs, singleThreadMillisecs / millisecs);
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include "../src/ECS/ECS.h"
+#include "../src/Components/TransformComponent.h"
+#include "../src/Components/RigidBodyComponent.h"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// per entity cost of moving 100k entities, with the baseline system loop and storage and with a view
+// the registry logs to stdout, the results are printed to stderr
+
+const int NUM_ENTITIES = 100000;
+const int NUM_FRAMES = 50;
+
+// the storage of the baseline registry, reproduced here to time the loop the systems had before views:
+// the pools found the slot of an entity through a hash map, the registry kept them behind shared pointers
+// and cast one for every GetComponent, and the systems copied their entity list every frame
+namespace baseline {
+    class IPool {
+        public:
+            virtual ~IPool() = default;
+    };
+
+    template <typename T>
+    class Pool: public IPool {
+        private:
+            std::vector<T> data;
+            std::unordered_map<int, int> entityIdToIndex;
+
+        public:
+            void Add(int entityId, T object) {
+                entityIdToIndex.emplace(entityId, static_cast<int>(data.size()));
+                data.push_back(object);
+            }
+
+            T& Get(int entityId) {
+                int index = entityIdToIndex[entityId];
+                return static_cast<T&>(data[index]);
+            }
+    };
+
+    class Registry {
+        private:
+            std::vector<std::shared_ptr<IPool>> componentPools;
+
+        public:
+            std::vector<int> systemEntities;
+
+            template <typename TComponent>
+            void AddComponent(int entityId, TComponent component) {
+                const auto componentId = Component<TComponent>::GetId();
+                if (componentId >= static_cast<int>(componentPools.size())) {
+                    componentPools.resize(componentId + 1, nullptr);
+                }
+                if (!componentPools[componentId]) {
+                    componentPools[componentId] = std::make_shared<Pool<TComponent>>();
+                }
+                std::static_pointer_cast<Pool<TComponent>>(componentPools[componentId])->Add(entityId, component);
+            }
+
+            template <typename TComponent>
+            TComponent& GetComponent(int entityId) const {
+                auto componentPool = std::static_pointer_cast<Pool<TComponent>>(componentPools[Component<TComponent>::GetId()]);
+                return componentPool->Get(entityId);
+            }
+
+            std::vector<int> GetSystemEntities() const {
+                return systemEntities;
+            }
+    };
+
+    void UpdateMovement(const Registry& registry, double deltaTime) {
+        for (auto entityId : registry.GetSystemEntities()) {
+            auto& transform = registry.GetComponent<TransformComponent>(entityId);
+            const auto rigidBody = registry.GetComponent<RigidBodyComponent>(entityId);
+            transform.position.x += rigidBody.velocity.x * deltaTime;
+            transform.position.y += rigidBody.velocity.y * deltaTime;
+        }
+    }
+}
+
+template <typename TFunc>
+double NanosecsPerEntity(TFunc&& func) {
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < NUM_FRAMES; frame++) {
+        func();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / NUM_FRAMES / NUM_ENTITIES;
+}
+
+int main() {
+    baseline::Registry baselineRegistry;
+    for (int entityId = 0; entityId < NUM_ENTITIES; entityId++) {
+        baselineRegistry.AddComponent<TransformComponent>(entityId, TransformComponent(glm::vec2(0.0, 0.0), glm::vec2(1.0, 1.0), 0.0));
+        baselineRegistry.AddComponent<RigidBodyComponent>(entityId, RigidBodyComponent(glm::vec2(10.0, 20.0)));
+        baselineRegistry.systemEntities.push_back(entityId);
+    }
+
+    Registry registry;
+
+    Prefab movingPrefab;
+    movingPrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(1.0, 1.0), 0.0);
+    movingPrefab.AddComponent<RigidBodyComponent>(glm::vec2(10.0, 20.0));
+    registry.Instantiate(movingPrefab, NUM_ENTITIES);
+    registry.Update();
+
+    double deltaTime = 1.0 / 60.0;
+    double baselineLoop = NanosecsPerEntity([&]() {
+        baseline::UpdateMovement(baselineRegistry, deltaTime);
+    });
+    double view = NanosecsPerEntity([&]() {
+        registry.View<TransformComponent, const RigidBodyComponent>().Each([deltaTime](Entity, TransformComponent& transform, const RigidBodyComponent& rigidBody) {
+            transform.position.x += rigidBody.velocity.x * deltaTime;
+            transform.position.y += rigidBody.velocity.y * deltaTime;
+        });
+    });
+
+    fprintf(stderr, "View benchmark, %d entities with a transform and a rigid body\n", NUM_ENTITIES);
+    fprintf(stderr, "    baseline storage, system entities copy + GetComponent: %6.2f ns/entity\n", baselineLoop);
+    fprintf(stderr, "    View<Transform, RigidBody>().Each:                     %6.2f ns/entity\n", view);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef COMPONENTTYPES_H
+#define COMPONENTTYPES_H
+
+#include "../ECS/TypeList.h"
+
+struct TransformComponent;
+struct RigidBodyComponent;
+struct SpriteComponent;
+struct AnimationComponent;
+struct BoxColliderComponent;
+struct KeyboardControlledComponent;
+struct CameraFollowComponent;
+struct HealthComponent;
+struct ProjectileEmitterComponent;
+struct ProjectileComponent;
+struct TextLabelComponent;
+struct ScriptComponent;
+
+// the component types of the game, the id of each one is its position in the list, known at compile time
+// a component type that is not listed still works, it gets an id after these the first time it is used
+typedef TypeList<
+    TransformComponent,
+    RigidBodyComponent,
+    SpriteComponent,
+    AnimationComponent,
+    BoxColliderComponent,
+    KeyboardControlledComponent,
+    CameraFollowComponent,
+    HealthComponent,
+    ProjectileEmitterComponent,
+    ProjectileComponent,
+    TextLabelComponent,
+    ScriptComponent
+> ComponentTypes;
+
+#endif
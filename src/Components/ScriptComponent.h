@@ -7,7 +7,7 @@ struct ScriptComponent {
     sol::function func;
 
     ScriptComponent(sol::function func = sol::lua_nil) {
-        this->func = func;
+        this->func = std::move(func);
     }
 };
 
@@ -1,29 +1,67 @@
 #ifndef SPRITECOMPONENT_H
 #define SPRITECOMPONENT_H
 
+#include "../ECS/ECS.h"
 #include <string>
+#include <utility>
+#include <functional>
 #include <SDL2/SDL.h>
 
-struct SpriteComponent {
+// the part of a sprite that is the same for every entity drawing it, like all the tiles of a map,
+// it is stored once and shared by the sprite components
+struct SpriteData {
     std::string assetId;
     int width;
     int height;
     int zIndex;
     bool isFixed;
+
+    SpriteData(std::string assetId = "", int width = 0, int height = 0, int zIndex = 0, bool isFixed = false) {
+        this->assetId = std::move(assetId);
+        this->width = width;
+        this->height = height;
+        this->zIndex = zIndex;
+        this->isFixed = isFixed;
+    }
+
+    bool operator ==(const SpriteData& other) const {
+        return assetId == other.assetId && width == other.width && height == other.height && zIndex == other.zIndex && isFixed == other.isFixed;
+    }
+};
+
+// the shared pool finds the sprite data by hash
+namespace std {
+    template <>
+    struct hash<SpriteData> {
+        size_t operator ()(const SpriteData& data) const {
+            size_t hash = std::hash<std::string>()(data.assetId);
+            for (int value : {data.width, data.height, data.zIndex, static_cast<int>(data.isFixed)}) {
+                hash = hash * 31 + std::hash<int>()(value);
+            }
+            return hash;
+        }
+    };
+}
+
+struct SpriteComponent {
+    Shared<SpriteData> data;
     SDL_RendererFlip flip;
     SDL_Rect srcRect;
-    
+
     // a default constructo is needed
     SpriteComponent(std::string assetId = "", int width = 0, int height = 0, int zIndex = 0, bool isFixed = false, int srcRectX = 0, int srcRectY = 0) {
-        this->assetId = assetId;
-        this->width = width;
-        this->height = height;
+        this->data = SpriteData(std::move(assetId), width, height, zIndex, isFixed);
         this->flip = SDL_FLIP_NONE;
-        this->isFixed = isFixed;
-        this->zIndex = zIndex;
         this->srcRect = {srcRectX, srcRectY, width, height};
     }
+
+    // with sprite data shared already, nothing is interned
+    SpriteComponent(Shared<SpriteData> data, int srcRectX = 0, int srcRectY = 0) {
+        this->data = data;
+        this->flip = SDL_FLIP_NONE;
+        this->srcRect = {srcRectX, srcRectY, data->width, data->height};
+    }
 };
 
 
-#endif
\ No newline at end of file
+#endif
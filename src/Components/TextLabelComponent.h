@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 #include <string>
+#include <utility>
 #include <SDL2/SDL.h>
 
 struct TextLabelComponent {
@@ -14,8 +15,8 @@ struct TextLabelComponent {
 
     TextLabelComponent(glm::vec2 position = glm::vec2(0), std::string text = "", std::string assetId = "", const SDL_Color& color = {0,0,0}, bool isFixed = true) {
         this->position = position;
-        this->text = text;
-        this->assetId = assetId;
+        this->text = std::move(text);
+        this->assetId = std::move(assetId);
         this->color = color;
         this->isFixed = isFixed;
     }
@@ -2,10 +2,22 @@
 #include <algorithm>
 #include "../Logger/Logger.h"
 
-int IComponent::nextId = 0;
+int IComponent::nextId = ComponentTypes::SIZE;
+
+int ISystemType::nextId = SystemTypes::SIZE;
+
+Registry* Entity::registry = nullptr;
 
 int Entity::GetId() const {
-    return id;
+    return static_cast<int>(handle & INDEX_MASK);
+}
+
+uint32_t Entity::GetGeneration() const {
+    return handle >> INDEX_BITS;
+}
+
+bool Entity::IsAlive() const {
+    return registry->IsAlive(*this);
 }
 
 void Entity::Kill() {
@@ -28,17 +40,138 @@ bool Entity::BelongsToGroup(const std::string& group) const{
     return registry->EntityBelongsToGroup(*this, group);
 }
 
+void Entity::Tag(int tagId) {
+    registry->TagEntity(*this, tagId);
+}
+
+bool Entity::HasTag(int tagId) const {
+    return registry->EntityHasTag(*this, tagId);
+}
+
+void Entity::Group(int groupId) {
+    registry->GroupEntity(*this, groupId);
+}
+
+bool Entity::BelongsToGroup(int groupId) const {
+    return registry->EntityBelongsToGroup(*this, groupId);
+}
+
+EntityFilter& EntityFilter::WithTag(const std::string& tag) {
+    const int tagId = Registry::GetTagId(tag);
+    if (tagId != -1) {
+        tags.set(tagId);
+    }
+    return *this;
+}
+
+EntityFilter& EntityFilter::InGroup(const std::string& group) {
+    const int groupId = Registry::GetGroupId(group);
+    if (groupId != -1) {
+        groups.set(groupId);
+    }
+    return *this;
+}
+
+bool EntityFilter::Matches(Entity entity) const {
+    return Entity::registry->EntityMatches(entity, *this);
+}
+
+bool EntityPairFilter::Apply(Entity& a, Entity& b) const {
+    if (first.Matches(a) && second.Matches(b)) {
+        return true;
+    }
+    if (first.Matches(b) && second.Matches(a)) {
+        std::swap(a, b);
+        return true;
+    }
+    return false;
+}
+
 void System::AddEntityToSystem(Entity entity) {
+    const auto entityId = entity.GetId();
+    if (entityId >= static_cast<int>(entityIdToSlot.size())) {
+        entityIdToSlot.resize(entityId + 1, -1);
+    }
+    if (entityIdToSlot[entityId] != -1) {
+        return;
+    }
+
+    if (!entities.empty() && entities.back().GetId() > entityId) {
+        isSorted = false;
+    }
+    entityIdToSlot[entityId] = static_cast<int>(entities.size());
     entities.push_back(entity);
 }
 
-void System::RemoveEntityFromSystem(Entity entity) {
-    entities.erase(std::remove_if(entities.begin(), entities.end(), [&entity](Entity other) {
-        return entity == other;
+void System::RemoveEntitiesFromSystem(const std::vector<Entity>& entitiesToRemove) {
+    // swapping each entity out is cheaper when few of them leave
+    if (entitiesToRemove.size() * 4 < entities.size()) {
+        for (auto entity : entitiesToRemove) {
+            RemoveEntityFromSystem(entity);
+        }
+        return;
+    }
+
+    // otherwise compact the whole list once
+    for (auto entity : entitiesToRemove) {
+        if (HasEntity(entity)) {
+            entityIdToSlot[entity.GetId()] = -1;
+        }
+    }
+    entities.erase(std::remove_if(entities.begin(), entities.end(), [this](Entity entity) {
+        return entityIdToSlot[entity.GetId()] == -1;
     }), entities.end());
+    for (int slot = 0; slot < static_cast<int>(entities.size()); slot++) {
+        entityIdToSlot[entities[slot].GetId()] = slot;
+    }
+}
+
+void System::SortEntities() {
+    if (isSorted) {
+        return;
+    }
+    // the slots are indexed by entity id, walking them gives the entities in id order without comparing them
+    std::vector<Entity> sortedEntities;
+    sortedEntities.reserve(entities.size());
+    for (int entityId = 0; entityId < static_cast<int>(entityIdToSlot.size()); entityId++) {
+        const int slot = entityIdToSlot[entityId];
+        if (slot != -1) {
+            entityIdToSlot[entityId] = static_cast<int>(sortedEntities.size());
+            sortedEntities.push_back(entities[slot]);
+        }
+    }
+    entities.swap(sortedEntities);
+    isSorted = true;
+}
+
+bool System::IsSorted() const {
+    return isSorted;
 }
 
-std::vector<Entity> System::GetSystemEntities() const {
+void System::RemoveEntityFromSystem(Entity entity) {
+    if (!HasEntity(entity)) {
+        return;
+    }
+
+    // move the last entity into the freed slot to keep the vector packed
+    const int slot = entityIdToSlot[entity.GetId()];
+    const Entity last = entities.back();
+    if (last != entity) {
+        isSorted = false;
+    }
+    entities[slot] = last;
+    entityIdToSlot[last.GetId()] = slot;
+
+    entities.pop_back();
+    entityIdToSlot[entity.GetId()] = -1;
+}
+
+bool System::HasEntity(Entity entity) const {
+    const auto entityId = entity.GetId();
+    return entityId < static_cast<int>(entityIdToSlot.size()) && entityIdToSlot[entityId] != -1;
+}
+
+const std::vector<Entity>& System::GetSystemEntities() const {
     return entities;
 }
 
@@ -46,14 +179,48 @@ const Signature& System::GetComponentSignature() const {
     return componentSignature;
 }
 
+const Signature& System::GetExcludedSignature() const {
+    return excludedSignature;
+}
+
+bool System::IsInterestedIn(const Signature& entityComponentSignature) const {
+    return (entityComponentSignature & componentSignature) == componentSignature && (entityComponentSignature & excludedSignature).none();
+}
+
+bool System::IsExclusive() const {
+    return isExclusive;
+}
+
+bool System::ConflictsWith(const System& other) const {
+    if (isExclusive || other.isExclusive) {
+        return true;
+    }
+    // a component written by one system cannot be read or written by the other
+    return (writeSignature & other.readSignature).any() || (other.writeSignature & readSignature).any();
+}
+
+void System::RunExclusively() {
+    isExclusive = true;
+}
+
 Entity Registry::CreateEntity() {
     int entityId;
 
     if (freeIds.empty()) {
         // if no free ids waiting to be reused
         entityId = numEntities++;
+        if (entityId >= static_cast<int>(Entity::INDEX_MASK)) {
+            Logger::Err("Entity ids are exhausted, handles of entity id " + std::to_string(entityId) + " will alias other entities");
+        }
         if (entityId >= static_cast<int>(entityComponentSignatures.size())) {
             entityComponentSignatures.resize(entityId + 1);
+            systemsPerEntity.resize(entityId + 1);
+            pendingSignatureChanges.resize(entityId + 1);
+            tagsPerEntity.resize(entityId + 1);
+            groupsPerEntity.resize(entityId + 1);
+            std::lock_guard<std::mutex> lock(entitiesToBeKilledMutex);
+            isEntityToBeKilled.resize(entityId + 1, false);
+            entityGenerations.resize(entityId + 1, 0);
         }
     } else {
         // reuse an id from list of previously removed entities
@@ -61,127 +228,1032 @@ Entity Registry::CreateEntity() {
         freeIds.pop_front();
     }
 
-    Entity entity(entityId);
-    entity.registry = this;
-    entitiesToBeAdded.insert(entity);
+    Entity entity = GetEntity(entityId);
+    entitiesToBeAdded.push_back(entity);
 
-    Logger::Log("Entity created with id = " + std::to_string(entityId));
+    if (Logger::isEnabled) {
+        Logger::Log("Entity created with id = " + std::to_string(entityId));
+    }
 
     return entity;
 }
 
+std::vector<Entity> Registry::CreateEntities(int count) {
+    // grow the per entity arrays once for the ids that cannot be reused
+    const int numNewIds = std::max(0, count - static_cast<int>(freeIds.size()));
+    if (numEntities + numNewIds >= static_cast<int>(Entity::INDEX_MASK)) {
+        Logger::Err("Entity ids are exhausted, handles of new entities will alias other entities");
+    }
+    if (numEntities + numNewIds > static_cast<int>(entityComponentSignatures.size())) {
+        const int size = numEntities + numNewIds;
+        entityComponentSignatures.resize(size);
+        systemsPerEntity.resize(size);
+        pendingSignatureChanges.resize(size);
+        tagsPerEntity.resize(size);
+        groupsPerEntity.resize(size);
+        std::lock_guard<std::mutex> lock(entitiesToBeKilledMutex);
+        isEntityToBeKilled.resize(size, false);
+        entityGenerations.resize(size, 0);
+    }
+
+    std::vector<Entity> entities;
+    entities.reserve(count);
+
+    for (int i = 0; i < count; i++) {
+        int entityId;
+        if (freeIds.empty()) {
+            entityId = numEntities++;
+        } else {
+            entityId = freeIds.front();
+            freeIds.pop_front();
+        }
+        entities.push_back(GetEntity(entityId));
+    }
+
+    entitiesToBeAdded.insert(entitiesToBeAdded.end(), entities.begin(), entities.end());
+
+    return entities;
+}
+
+std::vector<Entity> Registry::Instantiate(const Prefab& prefab, int count) {
+    std::vector<Entity> entities = CreateEntities(count);
+
+    for (const auto& component : prefab.components) {
+        component.instantiate(*this, component.prototype.get(), entities);
+        if (IsObserved(component.componentId)) {
+            for (auto entity : entities) {
+                RecordComponentChange(component.componentId, entity.GetId(), ComponentObservers::ADDED);
+            }
+        }
+    }
+
+    // archetypes whose components are all part of the prefab pack every instance
+    std::vector<int> packedComponentIds;
+    for (const auto& archetype : archetypes) {
+        if ((prefab.signature & archetype->signature) == archetype->signature) {
+            packedComponentIds.push_back(archetype->componentIds[0]);
+        }
+    }
+
+    for (auto entity : entities) {
+        entityComponentSignatures[entity.GetId()] = prefab.signature;
+        for (auto componentId : packedComponentIds) {
+            PackEntity(componentId, entity.GetId());
+        }
+        if (prefab.groupId != -1) {
+            groupsPerEntity[entity.GetId()].set(prefab.groupId);
+        }
+    }
+
+    Logger::Log(std::to_string(count) + " entities instantiated from a prefab with " + std::to_string(prefab.components.size()) + " components");
+
+    return entities;
+}
+
 void Registry::KillEntity(Entity entity) {
-    entitiesToBeKilled.insert(entity);
+    std::lock_guard<std::mutex> lock(entitiesToBeKilledMutex);
+
+    // a stale handle must not kill the entity that reused its id
+    if (!IsValid(entity)) {
+        return;
+    }
+
+    if (!isEntityToBeKilled[entity.GetId()]) {
+        isEntityToBeKilled[entity.GetId()] = true;
+        entitiesToBeKilled.push_back(entity);
+    }
+}
+
+bool Registry::IsValid(Entity entity) const {
+    const auto entityId = entity.GetId();
+    return entityId < static_cast<int>(entityGenerations.size()) && entityGenerations[entityId] == entity.GetGeneration();
+}
+
+bool Registry::IsAlive(Entity entity) const {
+    const auto entityId = entity.GetId();
+    return entityId < static_cast<int>(entityGenerations.size()) &&
+        entityGenerations[entityId] == entity.GetGeneration() &&
+        !isEntityToBeKilled[entityId];
+}
+
+void Registry::Submit(CommandBuffer&& commandBuffer, int sortKey) {
+    if (commandBuffer.IsEmpty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(submittedCommandBuffersMutex);
+    submittedCommandBuffers.emplace_back(sortKey, std::move(commandBuffer));
 }
 
 void Registry::AddEntityToSystems(Entity entity) {
+    if (!IsValid(entity)) {
+        return;
+    }
     const auto entityId = entity.GetId();
 
     const auto entityComponentSignature = entityComponentSignatures[entityId];
 
     // loop all the systems
     for (auto& system: systems) {
-        const auto& systemComponentsignature = system.second->GetComponentSignature();
+        if (!system) {
+            continue;
+        }
+        bool isInterested = system->IsInterestedIn(entityComponentSignature);
+
+        if (isInterested && !system->HasEntity(entity)) {
+            system->AddEntityToSystem(entity);
+            systemsPerEntity[entityId].push_back(system.get());
+        }
+    }
+}
+
+void Registry::AddEntitiesToSystems(const std::vector<Entity>& entities) {
+    Signature matchedSignature;
+    std::vector<System*> matchedSystems;
+    bool hasMatched = false;
+
+    for (auto entity : entities) {
+        const auto entityId = entity.GetId();
+        const auto& entityComponentSignature = entityComponentSignatures[entityId];
+
+        if (!hasMatched || entityComponentSignature != matchedSignature) {
+            matchedSignature = entityComponentSignature;
+            matchedSystems.clear();
+            for (auto& system : systems) {
+                if (!system) {
+                    continue;
+                }
+                if (system->IsInterestedIn(entityComponentSignature)) {
+                    matchedSystems.push_back(system.get());
+                }
+            }
+            hasMatched = true;
+        }
+
+        for (auto system : matchedSystems) {
+            if (!system->HasEntity(entity)) {
+                system->AddEntityToSystem(entity);
+                systemsPerEntity[entityId].push_back(system);
+            }
+        }
+    }
+}
+
+void Registry::QueueSignatureChange(int entityId, int componentId) {
+    auto& pendingSignatureChange = pendingSignatureChanges[entityId];
+    if (pendingSignatureChange.none()) {
+        entitiesWithSignatureChanges.push_back(entityId);
+    }
+    pendingSignatureChange.set(componentId);
+}
+
+void Registry::ApplySignatureChanges() {
+    const int numComponents = static_cast<int>(systemsPerComponent.size());
+
+    for (auto entityId : entitiesWithSignatureChanges) {
+        const Signature changedComponents = pendingSignatureChanges[entityId];
+        pendingSignatureChanges[entityId].reset();
+
+        const auto& entityComponentSignature = entityComponentSignatures[entityId];
+        auto& entitySystems = systemsPerEntity[entityId];
+        Entity entity = GetEntity(entityId);
+
+        for (int componentId = 0; componentId < numComponents; componentId++) {
+            if (!changedComponents[componentId]) {
+                continue;
+            }
+            for (auto system : systemsPerComponent[componentId]) {
+                bool isInterested = system->IsInterestedIn(entityComponentSignature);
+
+                if (isInterested && !system->HasEntity(entity)) {
+                    system->AddEntityToSystem(entity);
+                    entitySystems.push_back(system);
+                } else if (!isInterested && system->HasEntity(entity)) {
+                    system->RemoveEntityFromSystem(entity);
+                    entitySystems.erase(std::find(entitySystems.begin(), entitySystems.end(), system));
+                }
+            }
+        }
+    }
+    entitiesWithSignatureChanges.clear();
+}
+
+void Registry::IndexSystem(System* system) {
+    // adding an excluded component takes the entity out of the system, so it is indexed too
+    const Signature systemComponentSignature = system->GetComponentSignature() | system->GetExcludedSignature();
+    for (int componentId = 0; componentId < static_cast<int>(MAX_COMPONENTS); componentId++) {
+        if (systemComponentSignature[componentId]) {
+            if (componentId >= static_cast<int>(systemsPerComponent.size())) {
+                systemsPerComponent.resize(componentId + 1);
+            }
+            systemsPerComponent[componentId].push_back(system);
+        }
+    }
+}
+
+void Registry::UnindexSystem(System* system) {
+    for (auto& componentSystems : systemsPerComponent) {
+        componentSystems.erase(std::remove(componentSystems.begin(), componentSystems.end(), system), componentSystems.end());
+    }
+}
+
+bool Registry::IsObserved(int componentId) const {
+    return componentId < static_cast<int>(componentObservers.size()) && componentObservers[componentId];
+}
+
+ComponentObservers& Registry::AssureObservers(int componentId) {
+    if (componentId >= static_cast<int>(componentObservers.size())) {
+        componentObservers.resize(componentId + 1);
+    }
+    if (!componentObservers[componentId]) {
+        componentObservers[componentId] = std::make_unique<ComponentObservers>();
+    }
+    return *componentObservers[componentId];
+}
+
+void Registry::RecordComponentChange(int componentId, int entityId, ComponentObservers::Change change) {
+    auto& observers = *componentObservers[componentId];
+    if (entityId >= static_cast<int>(observers.pendingChanges.size())) {
+        observers.pendingChanges.resize(entityId + 1, 0);
+    }
+
+    char& pendingChange = observers.pendingChanges[entityId];
+    if (pendingChange == 0) {
+        observers.changedEntities.push_back(GetEntity(entityId));
+    }
+
+    // fold the change into the net change of the frame
+    switch (change) {
+        case ComponentObservers::ADDED:
+            // removed earlier in the frame, so the entity had the component when the frame started
+            pendingChange = pendingChange == ComponentObservers::REMOVED ? ComponentObservers::REPLACED : ComponentObservers::ADDED;
+            break;
+        case ComponentObservers::REPLACED:
+            if (pendingChange != ComponentObservers::ADDED) {
+                pendingChange = ComponentObservers::REPLACED;
+            }
+            break;
+        case ComponentObservers::REMOVED:
+            // a component added in this frame was never seen by the observers, so the changes cancel out
+            // ADDED | REMOVED is reported to nobody, but keeps the entity from being listed twice
+            pendingChange = pendingChange == ComponentObservers::ADDED ? ComponentObservers::ADDED | ComponentObservers::REMOVED : ComponentObservers::REMOVED;
+            break;
+    }
+}
+
+void Registry::NotifyObservers() {
+    std::vector<Entity> added;
+    std::vector<Entity> replaced;
+    std::vector<Entity> removed;
+
+    for (auto& observers : componentObservers) {
+        if (!observers || observers->changedEntities.empty()) {
+            continue;
+        }
 
-        bool isInterested = (entityComponentSignature & systemComponentsignature) == systemComponentsignature;
+        // sort the batches out first, observers can change components again and the changes belong to the next frame
+        added.clear();
+        replaced.clear();
+        removed.clear();
+        for (auto entity : observers->changedEntities) {
+            switch (observers->pendingChanges[entity.GetId()]) {
+                case ComponentObservers::ADDED: added.push_back(entity); break;
+                case ComponentObservers::REPLACED: replaced.push_back(entity); break;
+                case ComponentObservers::REMOVED: removed.push_back(entity); break;
+            }
+            observers->pendingChanges[entity.GetId()] = 0;
+        }
+        observers->changedEntities.clear();
 
-        if (isInterested) {
-            system.second->AddEntityToSystem(entity);
+        if (!added.empty()) {
+            for (auto& observer : observers->onAdd) {
+                observer(added);
+            }
+        }
+        if (!replaced.empty()) {
+            for (auto& observer : observers->onReplace) {
+                observer(replaced);
+            }
+        }
+        if (!removed.empty()) {
+            for (auto& observer : observers->onRemove) {
+                observer(removed);
+            }
         }
     }
 }
 
 void Registry::RemoveEntityFromSystems(Entity entity) {
-    for (auto system : systems) {
-        system.second->RemoveEntityFromSystem(entity);
+    if (!IsValid(entity)) {
+        return;
+    }
+    // only visit the systems the entity was added to
+    auto& entitySystems = systemsPerEntity[entity.GetId()];
+    for (auto system : entitySystems) {
+        system->RemoveEntityFromSystem(entity);
+    }
+    entitySystems.clear();
+}
+
+
+void Registry::PackEntity(int componentId, int entityId) {
+    auto& archetype = *archetypes[componentArchetypes[componentId]];
+    const auto& entityComponentSignature = entityComponentSignatures[entityId];
+    if ((entityComponentSignature & archetype.signature) != archetype.signature) {
+        return;
+    }
+
+    // already inside the packed region
+    if (componentPools[componentId]->IndexOf(entityId) < archetype.packedSize) {
+        return;
+    }
+
+    // swap the entity to the end of the packed region of every owned pool
+    for (auto ownedComponentId : archetype.componentIds) {
+        auto& pool = componentPools[ownedComponentId];
+        pool->SwapIndices(pool->IndexOf(entityId), archetype.packedSize);
+    }
+    archetype.packedSize++;
+}
+
+void Registry::UnpackEntity(int componentId, int entityId) {
+    auto& archetype = *archetypes[componentArchetypes[componentId]];
+    const int index = componentPools[componentId]->IndexOf(entityId);
+    if (index == -1 || index >= archetype.packedSize) {
+        return;
+    }
+
+    // swap the entity with the last packed one in every owned pool and shrink the packed region
+    archetype.packedSize--;
+    for (auto ownedComponentId : archetype.componentIds) {
+        auto& pool = componentPools[ownedComponentId];
+        pool->SwapIndices(pool->IndexOf(entityId), archetype.packedSize);
+    }
+}
+
+void IncrementalSort::Start(const IPool& pool, int begin, int end) {
+    this->pool = &pool;
+    indices.resize(end - begin);
+    for (int i = 0; i < end - begin; i++) {
+        indices[i] = pool.GetEntityId(begin + i);
+    }
+    merged.resize(indices.size());
+    width = 0;
+    position = 0;
+    out = -1;
+}
+
+bool IncrementalSort::Advance(int maxWork) {
+    const int n = static_cast<int>(indices.size());
+    int work = 0;
+
+    // sort short runs by insertion first
+    while (width == 0 && work < maxWork) {
+        const int runEnd = std::min(position + RUN_SIZE, n);
+        for (int i = position + 1; i < runEnd; i++) {
+            const int index = indices[i];
+            int j = i;
+            while (j > position && IsBefore(index, indices[j - 1])) {
+                indices[j] = indices[j - 1];
+                j--;
+            }
+            indices[j] = index;
+        }
+        work += (runEnd - position) * 4;
+        position = runEnd;
+        if (position >= n) {
+            width = RUN_SIZE;
+            position = 0;
+        }
     }
+
+    // then merge pairs of runs, doubling their size every pass
+    while (width > 0 && width < n && work < maxWork) {
+        const int middle = std::min(position + width, n);
+        const int pairEnd = std::min(position + 2 * width, n);
+        if (out == -1) {
+            left = position;
+            right = middle;
+            out = position;
+        }
+        for (; out < pairEnd && work < maxWork; out++, work++) {
+            // equal slots keep the order they had, so a sorted region is left as it is
+            if (right >= pairEnd || (left < middle && !IsBefore(indices[right], indices[left]))) {
+                merged[out] = indices[left++];
+            } else {
+                merged[out] = indices[right++];
+            }
+        }
+        if (out == pairEnd) {
+            position = pairEnd;
+            out = -1;
+            if (position >= n) {
+                std::swap(indices, merged);
+                width *= 2;
+                position = 0;
+            }
+        }
+    }
+
+    return width >= n;
 }
 
+bool Registry::QueueDefragmentJobs() {
+    const int numArchetypes = static_cast<int>(archetypes.size());
+    const int numPools = static_cast<int>(componentPools.size());
+    const int numSteps = numArchetypes + numPools + static_cast<int>(systems.size());
+
+    // visit every step at most once, a step with nothing to sort costs a flag check
+    for (int i = 0; i < numSteps; i++) {
+        const int step = nextDefragmentStep;
+        nextDefragmentStep = (nextDefragmentStep + 1) % numSteps;
+
+        if (step < numArchetypes) {
+            const Archetype& archetype = *archetypes[step];
+            const bool isArchetypeSorted = std::all_of(archetype.componentIds.begin(), archetype.componentIds.end(), [this](int componentId) {
+                return componentPools[componentId]->IsSorted();
+            });
+            if (isArchetypeSorted) {
+                continue;
+            }
+
+            // the packed region holds the same entity in the same slot of every owned pool,
+            // so it is sorted once, by the first owned pool with an order, and every owned pool follows
+            std::vector<int> componentIds = archetype.componentIds;
+            auto leadingPool = std::find_if(componentIds.begin(), componentIds.end(), [this](int componentId) {
+                return componentPools[componentId]->HasOrder();
+            });
+            if (leadingPool != componentIds.end()) {
+                std::iter_swap(componentIds.begin(), leadingPool);
+            }
+            defragmentJobs.push_back({componentIds, step, true, {}, false});
+
+            // the entities outside the packed region are sorted by each pool alone
+            for (auto componentId : archetype.componentIds) {
+                defragmentJobs.push_back({{componentId}, step, false, {}, false});
+            }
+        } else if (step < numArchetypes + numPools) {
+            // the owned pools are sorted with their archetype
+            const int componentId = step - numArchetypes;
+            const auto& pool = componentPools[componentId];
+            if (!pool || pool->IsSorted() || componentArchetypes[componentId] != -1) {
+                continue;
+            }
+            defragmentJobs.push_back({{componentId}, -1, false, {}, false});
+        } else {
+            // sorting the entities of a system takes a single pass over them
+            auto& system = systems[step - numArchetypes - numPools];
+            if (!system || system->IsSorted()) {
+                continue;
+            }
+            system->SortEntities();
+            return true;
+        }
+        return true;
+    }
+    return false;
+}
+
+void Registry::Defragment(int budgetMillisecs) {
+    // comparisons made between two checks of the time left
+    const int SORT_STEP = 4096;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budgetMillisecs);
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (defragmentJobs.empty()) {
+            if (!QueueDefragmentJobs()) {
+                return;
+            }
+            continue;
+        }
+
+        // the region of a job, it may have grown or shrunk by the time its sort is done
+        DefragmentJob& job = defragmentJobs.front();
+        IPool& leadingPool = *componentPools[job.componentIds[0]];
+        const int packedSize = job.archetypeIndex == -1 ? 0 : archetypes[job.archetypeIndex]->packedSize;
+        const int begin = job.isPackedRegion ? 0 : packedSize;
+        const int end = job.isPackedRegion ? packedSize : leadingPool.GetSize();
+
+        if (!isDefragmentSortStarted) {
+            defragmentSort.Start(leadingPool, begin, end);
+            job.layoutVersions.clear();
+            for (auto componentId : job.componentIds) {
+                job.layoutVersions.push_back(componentPools[componentId]->GetLayoutVersion());
+            }
+            isDefragmentSortStarted = true;
+        }
+        if (!defragmentSort.Advance(SORT_STEP)) {
+            continue;
+        }
+
+        // the sorted entities still in the region take its first slots, the ones that entered it since keep their order after them
+        std::vector<int> indices;
+        indices.reserve(end - begin);
+        std::vector<bool> isPlaced(end - begin, false);
+        for (auto entityId : defragmentSort.GetEntityIds()) {
+            const int index = leadingPool.IndexOf(entityId);
+            if (index >= begin && index < end && !isPlaced[index - begin]) {
+                indices.push_back(index);
+                isPlaced[index - begin] = true;
+            }
+        }
+        for (int index = begin; index < end; index++) {
+            if (!isPlaced[index - begin]) {
+                indices.push_back(index);
+            }
+        }
+
+        const bool isRegionSorted = std::is_sorted(indices.begin(), indices.end());
+        bool isUnchanged = !job.isStale;
+        for (int i = 0; i < static_cast<int>(job.componentIds.size()); i++) {
+            IPool& pool = *componentPools[job.componentIds[i]];
+            isUnchanged = isUnchanged && pool.GetLayoutVersion() == job.layoutVersions[i];
+            if (!isRegionSorted) {
+                pool.Permute(begin, indices);
+            }
+            // the packed region is sorted first, a pool is sorted once its own slots are,
+            // a pool that changed while it was sorted is sorted again by a later pass
+            if (!job.isPackedRegion && isUnchanged) {
+                pool.MarkSorted();
+            }
+        }
+        if (job.isPackedRegion && !isUnchanged) {
+            for (auto& queuedJob : defragmentJobs) {
+                queuedJob.isStale = queuedJob.isStale || queuedJob.archetypeIndex == job.archetypeIndex;
+            }
+        }
+        defragmentJobs.pop_front();
+        isDefragmentSortStarted = false;
+    }
+}
+
+const Archetype* Registry::FindArchetype(const Signature& signature) const {
+    // prefer the archetype that owns most of the requested components
+    const Archetype* bestArchetype = nullptr;
+    for (auto& archetype : archetypes) {
+        bool isCovered = (signature & archetype->signature) == archetype->signature;
+        if (isCovered && (!bestArchetype || archetype->componentIds.size() > bestArchetype->componentIds.size())) {
+            bestArchetype = archetype.get();
+        }
+    }
+    return bestArchetype;
+}
+
+// tag and group names are interned once for the whole program, systems may look them up from worker threads
+static std::mutex internedNamesMutex;
+static std::unordered_map<std::string, int> tagIds;
+static std::unordered_map<std::string, int> groupIds;
+
+static int InternName(std::unordered_map<std::string, int>& ids, const std::string& name, unsigned int maxIds) {
+    std::lock_guard<std::mutex> lock(internedNamesMutex);
+    auto interned = ids.find(name);
+    if (interned != ids.end()) {
+        return interned->second;
+    }
+    if (ids.size() >= maxIds) {
+        Logger::Err("Cannot intern " + name + ", all the " + std::to_string(maxIds) + " ids are taken");
+        return -1;
+    }
+    const int id = static_cast<int>(ids.size());
+    ids.emplace(name, id);
+    return id;
+}
+
+static int FindName(const std::unordered_map<std::string, int>& ids, const std::string& name) {
+    std::lock_guard<std::mutex> lock(internedNamesMutex);
+    auto interned = ids.find(name);
+    return interned != ids.end() ? interned->second : -1;
+}
+
+int Registry::GetTagId(const std::string& tag) {
+    return InternName(tagIds, tag, MAX_TAGS);
+}
+
+int Registry::GetGroupId(const std::string& group) {
+    return InternName(groupIds, group, MAX_GROUPS);
+}
+
+int Registry::FindTagId(const std::string& tag) {
+    return FindName(tagIds, tag);
+}
+
+int Registry::FindGroupId(const std::string& group) {
+    return FindName(groupIds, group);
+}
 
 void Registry::TagEntity(Entity entity, const std::string& tag) {
-    entitiyPerTag.emplace(tag, entity);
-    tagPerEntity.emplace(entity.GetId(), tag);
+    TagEntity(entity, GetTagId(tag));
 }
 
-bool Registry::EntityHasTag(Entity entity, const std::string& tag) const {
-    if (tagPerEntity.find(entity.GetId()) == tagPerEntity.end()) {
-        return false;
+void Registry::TagEntity(Entity entity, int tagId) {
+    if (tagId == -1 || !IsValid(entity)) {
+        return;
+    }
+    if (tagId >= static_cast<int>(entityPerTag.size())) {
+        entityPerTag.resize(tagId + 1, -1);
+    }
+
+    // the tag moves away from the entity that had it before
+    const int previousEntityId = entityPerTag[tagId];
+    if (previousEntityId != -1) {
+        tagsPerEntity[previousEntityId].reset(tagId);
     }
-    return entitiyPerTag.find(tag)->second == entity;
+
+    entityPerTag[tagId] = entity.GetId();
+    tagsPerEntity[entity.GetId()].set(tagId);
+}
+
+bool Registry::EntityHasTag(Entity entity, const std::string& tag) const {
+    return EntityHasTag(entity, FindTagId(tag));
+}
+
+bool Registry::EntityHasTag(Entity entity, int tagId) const {
+    return tagId != -1 && IsValid(entity) && tagsPerEntity[entity.GetId()][tagId];
 }
 
 Entity Registry::GetEntityByTag(const std::string& tag) const {
-    return entitiyPerTag.at(tag);
+    const int tagId = FindTagId(tag);
+    if (tagId == -1 || tagId >= static_cast<int>(entityPerTag.size()) || entityPerTag[tagId] == -1) {
+        Logger::Err("No entity has the tag " + tag);
+        return Entity();
+    }
+    return GetEntity(entityPerTag[tagId]);
 }
 
 void Registry::RemoveEntityTag(Entity entity) {
-    auto taggedEntity = tagPerEntity.find(entity.GetId());
-    if (taggedEntity != tagPerEntity.end()) {
-        auto tag = taggedEntity->second;
-        entitiyPerTag.erase(tag);
-        tagPerEntity.erase(taggedEntity);
+    if (!IsValid(entity)) {
+        return;
+    }
+    auto& tags = tagsPerEntity[entity.GetId()];
+    if (tags.none()) {
+        return;
     }
+    for (int tagId = 0; tagId < static_cast<int>(entityPerTag.size()); tagId++) {
+        if (tags[tagId]) {
+            entityPerTag[tagId] = -1;
+        }
+    }
+    tags.reset();
 }
 
 void Registry::GroupEntity(Entity entity, const std::string& group) {
-    entitiesPerGroup.emplace(group, std::set<Entity>());
-    entitiesPerGroup[group].emplace(entity);
-    groupPerEntity.emplace(entity.GetId(), group);
+    GroupEntity(entity, GetGroupId(group));
+}
+
+void Registry::GroupEntity(Entity entity, int groupId) {
+    if (groupId != -1 && IsValid(entity)) {
+        groupsPerEntity[entity.GetId()].set(groupId);
+    }
 }
 
 bool Registry::EntityBelongsToGroup(Entity entity, const std::string& group) const {
-    if (entitiesPerGroup.find(group) == entitiesPerGroup.end()) {
+    return EntityBelongsToGroup(entity, FindGroupId(group));
+}
+
+bool Registry::EntityBelongsToGroup(Entity entity, int groupId) const {
+    return groupId != -1 && IsValid(entity) && groupsPerEntity[entity.GetId()][groupId];
+}
+
+bool Registry::EntityMatches(Entity entity, const EntityFilter& filter) const {
+    if (!IsValid(entity)) {
         return false;
     }
-    auto groupEntities = entitiesPerGroup.at(group);
-    return groupEntities.find(entity.GetId()) != groupEntities.end();
+    const int entityId = entity.GetId();
+    const auto& entityComponentSignature = entityComponentSignatures[entityId];
+    if ((entityComponentSignature & filter.signature) != filter.signature || (entityComponentSignature & filter.excludedSignature).any()) {
+        return false;
+    }
+    if (filter.tags.none() && filter.groups.none()) {
+        return true;
+    }
+    return (tagsPerEntity[entityId] & filter.tags).any() || (groupsPerEntity[entityId] & filter.groups).any();
 }
 
 std::vector<Entity> Registry::GetEntitesByGroup(const std::string& group) const {
-    auto &setOfEntities = entitiesPerGroup.at(group);
-    return std::vector<Entity>(setOfEntities.begin(), setOfEntities.end());
+    const int groupId = FindGroupId(group);
+    std::vector<Entity> entities;
+    if (groupId == -1) {
+        return entities;
+    }
+    for (int entityId = 0; entityId < static_cast<int>(groupsPerEntity.size()); entityId++) {
+        if (groupsPerEntity[entityId][groupId]) {
+            entities.push_back(GetEntity(entityId));
+        }
+    }
+    return entities;
 }
 
 void Registry::RemoveEntityGroup(Entity entity) {
-    auto groupedEntity = groupPerEntity.find(entity.GetId());
-    if (groupedEntity != groupPerEntity.end()) {
-        auto group = entitiesPerGroup.find(groupedEntity->second);
-        if (group != entitiesPerGroup.end()) {
-            auto entityInGroup = group->second.find(entity);
-            if (entityInGroup != group->second.end()) {
-                group->second.erase(entityInGroup);
-            }
-        }
-        groupPerEntity.erase(groupedEntity);
+    if (!IsValid(entity)) {
+        return;
     }
+    groupsPerEntity[entity.GetId()].reset();
 }
 
-
-void Registry::Update() {
-    // add entities waiting to be added to the active system
-    for (auto entity : entitiesToBeAdded) {
-        AddEntityToSystems(entity);
+void Registry::RemoveKilledEntities() {
+    if (entitiesToBeKilled.empty()) {
+        return;
     }
-    entitiesToBeAdded.clear();
 
-    // remove entities to be killed
+    // in id order, so the order of the freed ids does not depend on the threads that killed them
+    std::sort(entitiesToBeKilled.begin(), entitiesToBeKilled.end(), [](Entity a, Entity b) {
+        return a.GetId() < b.GetId();
+    });
+
+    // group the killed entities by signature and by system, so every component type, pool and system is visited once
+    std::vector<std::pair<Signature, std::vector<int>>> entityIdsPerSignature;
+    std::unordered_map<System*, std::vector<Entity>> entitiesPerSystem;
+
     for (auto entity : entitiesToBeKilled) {
-        RemoveEntityFromSystems(entity);
-        entityComponentSignatures[entity.GetId()].reset();
+        const auto entityId = entity.GetId();
+        const auto& entityComponentSignature = entityComponentSignatures[entityId];
+        isEntityToBeKilled[entityId] = false;
+
+        auto group = std::find_if(entityIdsPerSignature.begin(), entityIdsPerSignature.end(), [&entityComponentSignature](const auto& group) {
+            return group.first == entityComponentSignature;
+        });
+        if (group == entityIdsPerSignature.end()) {
+            entityIdsPerSignature.emplace_back(entityComponentSignature, std::vector<int>());
+            group = entityIdsPerSignature.end() - 1;
+        }
+        group->second.push_back(entityId);
+
+        for (auto system : systemsPerEntity[entityId]) {
+            entitiesPerSystem[system].push_back(entity);
+        }
+        systemsPerEntity[entityId].clear();
+    }
+
+    for (auto& systemEntities : entitiesPerSystem) {
+        systemEntities.first->RemoveEntitiesFromSystem(systemEntities.second);
+    }
+
+    std::vector<std::vector<int>> entityIdsPerComponent(componentPools.size());
+    for (const auto& group : entityIdsPerSignature) {
+        const Signature& signature = group.first;
+        const std::vector<int>& entityIds = group.second;
+
+        // take the entities out of the packed region of the archetypes before their components are removed
+        for (auto& archetype : archetypes) {
+            if ((signature & archetype->signature) == archetype->signature) {
+                for (auto entityId : entityIds) {
+                    UnpackEntity(archetype->componentIds[0], entityId);
+                }
+            }
+        }
+
+        for (int componentId = 0; componentId < static_cast<int>(componentPools.size()); componentId++) {
+            if (!signature.test(componentId)) {
+                continue;
+            }
+            auto& componentEntityIds = entityIdsPerComponent[componentId];
+            componentEntityIds.insert(componentEntityIds.end(), entityIds.begin(), entityIds.end());
 
-        // remove entity from component pools
-        for (auto pool : componentPools) {
-            if (pool) {
-                pool->RemoveEntityFromPool(entity.GetId());
+            // the observed components of the entities are removed with them
+            if (IsObserved(componentId)) {
+                for (auto entityId : entityIds) {
+                    RecordComponentChange(componentId, entityId, ComponentObservers::REMOVED);
+                }
             }
         }
+    }
 
-        // make the entity id available to be reused
-        freeIds.push_back(entity.GetId());
+    // a single call per pool, removing all its killed entities
+    for (int componentId = 0; componentId < static_cast<int>(componentPools.size()); componentId++) {
+        if (!entityIdsPerComponent[componentId].empty()) {
+            componentPools[componentId]->RemoveEntitiesFromPool(entityIdsPerComponent[componentId]);
+        }
+    }
 
+    for (auto entity : entitiesToBeKilled) {
+        const auto entityId = entity.GetId();
+        entityComponentSignatures[entityId].reset();
         RemoveEntityTag(entity);
         RemoveEntityGroup(entity);
+
+        // make the entity id available to be reused, by a new generation so the old handles go stale
+        entityGenerations[entityId] = (entityGenerations[entityId] + 1) & Entity::GENERATION_MASK;
+        freeIds.push_back(entityId);
     }
     entitiesToBeKilled.clear();
+}
+
+unsigned int Registry::BeginChangeQuery() {
+    // the changes made from now on are stamped with a later tick than the snapshot
+    return currentTick++;
+}
+
+void Registry::Update() {
+    // everything accessed mutably from now on belongs to a new tick
+    currentTick++;
+
+    // play back the structural changes recorded by command buffers, in a deterministic order
+    std::stable_sort(submittedCommandBuffers.begin(), submittedCommandBuffers.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    for (auto& submittedCommandBuffer : submittedCommandBuffers) {
+        submittedCommandBuffer.second.Playback(*this);
+    }
+    submittedCommandBuffers.clear();
+
+    // add entities waiting to be added to the active system
+    AddEntitiesToSystems(entitiesToBeAdded);
+    entitiesToBeAdded.clear();
+
+    // components added or removed on live entities may change the systems they belong to
+    ApplySignatureChanges();
+
+    RemoveKilledEntities();
+
+    NotifyObservers();
     
-}
\ No newline at end of file
+}
+
+void Prefab::Group(const std::string& group) {
+    groupId = Registry::GetGroupId(group);
+}
+
+const Signature& Prefab::GetSignature() const {
+    return signature;
+}
+
+CommandBuffer::CommandBuffer(CommandBuffer&& other) {
+    *this = std::move(other);
+}
+
+CommandBuffer& CommandBuffer::operator =(CommandBuffer&& other) {
+    DestroyComponents();
+    commands = std::move(other.commands);
+    numDeferredEntities = other.numDeferredEntities;
+    blocks = std::move(other.blocks);
+    blockOffset = other.blockOffset;
+    other.commands.clear();
+    other.numDeferredEntities = 0;
+    other.blockOffset = BLOCK_SIZE;
+    return *this;
+}
+
+CommandBuffer::~CommandBuffer() {
+    DestroyComponents();
+}
+
+bool CommandBuffer::IsEmpty() const {
+    return commands.empty();
+}
+
+void* CommandBuffer::Allocate(size_t size, size_t alignment) {
+    // objects larger than a block get a block of their own, the current block stays at the back
+    if (size > BLOCK_SIZE) {
+        blocks.insert(blocks.begin(), std::make_unique<unsigned char[]>(size));
+        return blocks.front().get();
+    }
+
+    size_t offset = (blockOffset + alignment - 1) / alignment * alignment;
+    if (offset + size > BLOCK_SIZE) {
+        blocks.push_back(std::make_unique<unsigned char[]>(BLOCK_SIZE));
+        offset = 0;
+    }
+    blockOffset = offset + size;
+    return blocks.back().get() + offset;
+}
+
+void CommandBuffer::Record(CommandType type, Entity entity) {
+    Command command;
+    command.type = type;
+    command.entity = entity;
+    commands.push_back(command);
+}
+
+void CommandBuffer::Record(CommandType type, DeferredEntity entity) {
+    Command command;
+    command.type = type;
+    command.deferredIndex = entity.index;
+    commands.push_back(command);
+}
+
+void CommandBuffer::DestroyComponents() {
+    for (auto& command : commands) {
+        if (command.destroyComponent) {
+            command.destroyComponent(command.component);
+        }
+    }
+    commands.clear();
+}
+
+DeferredEntity CommandBuffer::CreateEntity() {
+    Record(CommandType::CreateEntity, DeferredEntity{numDeferredEntities});
+    return DeferredEntity{numDeferredEntities++};
+}
+
+DeferredEntity CommandBuffer::Instantiate(const Prefab& prefab) {
+    Record(CommandType::Instantiate, DeferredEntity{numDeferredEntities});
+    commands.back().prefab = &prefab;
+    return DeferredEntity{numDeferredEntities++};
+}
+
+void CommandBuffer::KillEntity(Entity entity) {
+    Record(CommandType::KillEntity, entity);
+}
+
+void CommandBuffer::TagEntity(Entity entity, const std::string& tag) {
+    Record(CommandType::TagEntity, entity);
+    commands.back().nameId = Registry::GetTagId(tag);
+}
+
+void CommandBuffer::TagEntity(DeferredEntity entity, const std::string& tag) {
+    Record(CommandType::TagEntity, entity);
+    commands.back().nameId = Registry::GetTagId(tag);
+}
+
+void CommandBuffer::GroupEntity(Entity entity, const std::string& group) {
+    Record(CommandType::GroupEntity, entity);
+    commands.back().nameId = Registry::GetGroupId(group);
+}
+
+void CommandBuffer::GroupEntity(DeferredEntity entity, const std::string& group) {
+    Record(CommandType::GroupEntity, entity);
+    commands.back().nameId = Registry::GetGroupId(group);
+}
+
+void CommandBuffer::TagEntity(Entity entity, int tagId) {
+    Record(CommandType::TagEntity, entity);
+    commands.back().nameId = tagId;
+}
+
+void CommandBuffer::TagEntity(DeferredEntity entity, int tagId) {
+    Record(CommandType::TagEntity, entity);
+    commands.back().nameId = tagId;
+}
+
+void CommandBuffer::GroupEntity(Entity entity, int groupId) {
+    Record(CommandType::GroupEntity, entity);
+    commands.back().nameId = groupId;
+}
+
+void CommandBuffer::GroupEntity(DeferredEntity entity, int groupId) {
+    Record(CommandType::GroupEntity, entity);
+    commands.back().nameId = groupId;
+}
+
+void CommandBuffer::Playback(Registry& registry) {
+    // the deferred entities are created up front, in one batch per prefab and one for the plain entities,
+    // then the components added to them are moved in without a log line each
+    std::vector<Entity> createdEntities(numDeferredEntities);
+    std::vector<std::pair<const Prefab*, std::vector<int>>> deferredIndicesPerPrefab;
+    for (const auto& command : commands) {
+        if (command.type != CommandType::CreateEntity && command.type != CommandType::Instantiate) {
+            continue;
+        }
+        auto batch = std::find_if(deferredIndicesPerPrefab.begin(), deferredIndicesPerPrefab.end(), [&command](const auto& batch) {
+            return batch.first == command.prefab;
+        });
+        if (batch == deferredIndicesPerPrefab.end()) {
+            deferredIndicesPerPrefab.emplace_back(command.prefab, std::vector<int>());
+            batch = deferredIndicesPerPrefab.end() - 1;
+        }
+        batch->second.push_back(command.deferredIndex);
+    }
+    for (const auto& batch : deferredIndicesPerPrefab) {
+        const int count = static_cast<int>(batch.second.size());
+        std::vector<Entity> entities = batch.first ? registry.Instantiate(*batch.first, count) : registry.CreateEntities(count);
+        for (int i = 0; i < count; i++) {
+            createdEntities[batch.second[i]] = entities[i];
+        }
+    }
+
+    for (auto& command : commands) {
+        const bool isDeferred = command.deferredIndex != -1;
+        Entity entity = isDeferred ? createdEntities[command.deferredIndex] : command.entity;
+
+        // the entity may have been killed after the command was recorded
+        if (!isDeferred && !registry.IsAlive(entity)) {
+            continue;
+        }
+
+        switch (command.type) {
+            case CommandType::CreateEntity:
+            case CommandType::Instantiate:
+                break;
+            case CommandType::KillEntity:
+                registry.KillEntity(entity);
+                break;
+            case CommandType::AddComponent:
+                command.addComponent(registry, entity, command.component);
+                break;
+            case CommandType::RemoveComponent:
+                command.removeComponent(registry, entity);
+                break;
+            case CommandType::TagEntity:
+                registry.TagEntity(entity, command.nameId);
+                break;
+            case CommandType::GroupEntity:
+                registry.GroupEntity(entity, command.nameId);
+                break;
+        }
+    }
+
+    // the moved-from components still have to be destroyed
+    DestroyComponents();
+    numDeferredEntities = 0;
+    blocks.clear();
+    blockOffset = BLOCK_SIZE;
+}
@@ -2,16 +2,32 @@
 #define ECS_H
 
 #include "../Logger/Logger.h"
+#include "TypeList.h"
+#include "../Components/ComponentTypes.h"
+#include "../Systems/SystemTypes.h"
 
 #include <bitset>
 #include <vector>
 #include <unordered_map>
-#include <typeindex>
-#include <set>
 #include <memory>
 #include <deque>
+#include <algorithm>
+#include <tuple>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+#include <string>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <chrono>
+#include <cassert>
 
-const unsigned int MAX_COMPONENTS = 32;
+const unsigned int MAX_COMPONENTS = 64;
+
+static_assert(ComponentTypes::SIZE <= MAX_COMPONENTS, "too many component types");
 
 
 // Signature
@@ -19,31 +35,57 @@ const unsigned int MAX_COMPONENTS = 32;
 // and also helps keep the track of which entities a system is interested in
 typedef std::bitset<MAX_COMPONENTS> Signature;
 
+const unsigned int MAX_TAGS = 32;
+const unsigned int MAX_GROUPS = 32;
+
+// tags and groups an entity has, one bit per interned tag or group id
+typedef std::bitset<MAX_TAGS> TagMask;
+typedef std::bitset<MAX_GROUPS> GroupMask;
+
 struct IComponent {
     protected:
         static int nextId;
 };
 
 // used to assign a unique id to a component type
+// the types in ComponentTypes have their position in the list as a compile time id, the others get one at runtime
 template <typename T>
 class Component: public IComponent {
     public:
-        static int GetId() {
-            static auto id = nextId++;
-            return id;
-    }
+        static constexpr int STATIC_ID = TypeIndex<T, ComponentTypes>::value;
 
+        static int GetId() {
+            if constexpr (STATIC_ID != -1) {
+                return STATIC_ID;
+            } else {
+                static auto id = nextId++;
+                return id;
+            }
+        }
 };
 
+// an entity is a 32 bit handle packing its id, the index of the entity in the registry arrays,
+// with the generation of that index, which changes every time the index is freed by a killed entity,
+// so a handle kept after its entity was killed never refers to the entity reusing the index
 class Entity {
     private:
-        int id;
+        uint32_t handle;
 
     public:
-        Entity(int id): id(id) {};
+        static constexpr uint32_t INDEX_BITS = 20;
+        static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+        static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+        // the null handle never refers to a living entity, the last index is reserved for it
+        Entity(): handle(UINT32_MAX) {};
+        Entity(int id, uint32_t generation = 0): handle(((generation & GENERATION_MASK) << INDEX_BITS) | (static_cast<uint32_t>(id) & INDEX_MASK)) {};
         Entity(const Entity& entity) = default;
         void Kill();
         int GetId() const;
+        uint32_t GetGeneration() const;
+
+        // false once the entity was killed, and for stale handles of an index reused by another entity
+        bool IsAlive() const;
 
         // manage entity tags and groups
         void Tag(const std::string &tag);
@@ -51,28 +93,57 @@ class Entity {
         void Group(const std::string& group);
         bool BelongsToGroup(const std::string& group) const;
 
+        // same with interned ids, see Registry::GetTagId and Registry::GetGroupId
+        void Tag(int tagId);
+        bool HasTag(int tagId) const;
+        void Group(int groupId);
+        bool BelongsToGroup(int groupId) const;
+
         Entity& operator =(const Entity& other) = default;
-        bool operator ==(const Entity& other) const { return id == other.id; }
-        bool operator !=(const Entity& other) const { return id != other.id; }
-        bool operator >(const Entity& other) const { return id > other.id; }
-        bool operator <(const Entity& other) const { return id < other.id; }
+        bool operator ==(const Entity& other) const { return handle == other.handle; }
+        bool operator !=(const Entity& other) const { return handle != other.handle; }
+        bool operator >(const Entity& other) const { return handle > other.handle; }
+        bool operator <(const Entity& other) const { return handle < other.handle; }
 
         template <typename TComponent, typename ...TArgs> void AddComponent(TArgs&& ...args);
         template <typename TComponent> void RemoveComponent();
         template <typename TComponent> bool HasComponent() const;
         template <typename TComponent> TComponent& GetComponent() const;
 
-        // hold a pointer to the entity's owner registry
-        class Registry* registry;
-
+        // the registry the entities belong to, set by the registry constructor
+        // every entity handle goes through it, so only one registry can be alive at a time
+        static class Registry* registry;
+};
 
+// how a system uses a component type, so systems that do not conflict can run at the same time
+enum class ComponentAccess {
+    Read,
+    ReadWrite
 };
 
 // the system processes entities with signature
 class System {
     private:
         Signature componentSignature;
+
+        // components the entities of the system must not have
+        Signature excludedSignature;
+
+        // components the system reads and writes, including the ones it does not require
+        Signature readSignature;
+        Signature writeSignature;
+
+        // the system touches state outside the components (SDL, lua, event bus, entity creation)
+        // and has to run alone on the main thread
+        bool isExclusive = false;
         std::vector<Entity> entities;
+
+        // slot of each entity inside the entities vector, -1 if the entity is not in the system
+        // vector index = entity id
+        std::vector<int> entityIdToSlot;
+
+        // false once an entity is added out of id order or swapped into a freed slot, until SortEntities
+        bool isSorted = true;
     
     public:
         System() = default;
@@ -80,113 +151,674 @@ class System {
 
         void AddEntityToSystem(Entity entity);
         void RemoveEntityFromSystem(Entity entity);
-        std::vector<Entity> GetSystemEntities() const;
+        void RemoveEntitiesFromSystem(const std::vector<Entity>& entitiesToRemove);
+
+        // order the entities by id, so a loop over them reads the pools front to back
+        // it does nothing if no entity moved out of order since the last call
+        void SortEntities();
+        bool IsSorted() const;
+        bool HasEntity(Entity entity) const;
+        const std::vector<Entity>& GetSystemEntities() const;
         const Signature& GetComponentSignature() const;
+        const Signature& GetExcludedSignature() const;
+
+        // true if an entity with the given components belongs to the system
+        bool IsInterestedIn(const Signature& entityComponentSignature) const;
+        bool IsExclusive() const;
+
+        // true if the two systems cannot run at the same time
+        bool ConflictsWith(const System& other) const;
 
         // defines the component type that entities must have to be considered by the system
-        template <typename TComponent> void RequireComponent();
+        // Without<T> and Optional<T> work like in views: the same as ExcludeComponent<T> and AccessComponent<T>
+        template <typename TComponent> void RequireComponent(ComponentAccess access = ComponentAccess::ReadWrite);
+
+        // declares the access to a component type the system uses without requiring it,
+        // an optional component: entities are in the system whether they have it or not
+        template <typename TComponent> void AccessComponent(ComponentAccess access);
+
+        // defines a component type that entities must not have to be considered by the system
+        template <typename TComponent> void ExcludeComponent();
+
+        // declares that the system must run alone on the main thread
+        void RunExclusively();
+
+};
+
+struct ISystemType {
+    protected:
+        static int nextId;
+};
+
+// used to assign a unique id to a system type, the same way Component does with SystemTypes
+template <typename TSystem>
+class SystemType: public ISystemType {
+    public:
+        static constexpr int STATIC_ID = TypeIndex<TSystem, SystemTypes>::value;
 
+        static int GetId() {
+            if constexpr (STATIC_ID != -1) {
+                return STATIC_ID;
+            } else {
+                static auto id = nextId++;
+                return id;
+            }
+        }
 };
 
 class IPool {
     public:
         virtual ~IPool() = default;
         virtual void RemoveEntityFromPool(int entityId) = 0;
+        virtual void RemoveEntitiesFromPool(const std::vector<int>& entityIds) = 0;
+        virtual bool Contains(int entityId) const = 0;
+        virtual int IndexOf(int entityId) const = 0;
+        virtual int GetEntityId(int index) const = 0;
+        virtual void SwapIndices(int indexA, int indexB) = 0;
+        virtual int GetSize() const = 0;
+        virtual bool HasOrder() const = 0;
+        virtual bool IsSorted() const = 0;
+        virtual void MarkSorted() = 0;
+        virtual unsigned int GetLayoutVersion() const = 0;
+        virtual bool IsBefore(int indexA, int indexB) const = 0;
+        virtual void Permute(int begin, const std::vector<int>& indices) = 0;
 };
 
-// wrapper of vector containing entities
+// how the pool of a component type grows, specialize it for a component type to change its policy
+// example:
+//     template <> struct PoolGrowthPolicy<TileComponent> {
+//         static constexpr int INITIAL_CAPACITY = 4096;
+//         static int Grow(int capacity) { return capacity + 4096; }
+//     };
+template <typename T>
+struct PoolGrowthPolicy {
+    // capacity of the first allocation, made when the first component is added
+    static constexpr int INITIAL_CAPACITY = 16;
+
+    // capacity to reallocate to when the pool is full
+    static int Grow(int capacity) {
+        return capacity * 2;
+    }
+};
+
+// sparse set of components of a certain type
+// data and entityIds are the dense arrays, packed and parallel to each other
+// data is raw aligned storage, only the first size slots hold constructed components
+// versions is parallel to them too: every mutable access stamps the slot with the current tick of the registry,
+// const access does not, so the components changed since a given tick can be found
+// sparse maps an entity id to its index in the dense arrays, it is split into
+// fixed size pages that are only allocated when an entity id inside them is used
 template <typename T>
 class Pool: public IPool {
     private:
-    // keep track of vector if objects and current number of elements
-        std::vector<T> data;
-        int size;
+        static constexpr int PAGE_SIZE = 1024;
+        static constexpr int INVALID_INDEX = -1;
+        static constexpr unsigned int NO_TICK = 0;
+
+        // keep track of the component storage, its capacity and the current number of elements
+        T* data = nullptr;
+        int capacity = 0;
+        std::vector<int> entityIds;
+        int size = 0;
+
+        // tick of the last mutable access of each slot, and where the current tick is read from
+        std::vector<unsigned int> versions;
+        const unsigned int* tick = &NO_TICK;
+
+        void Stamp(int index) {
+            versions[index] = *tick;
+        }
 
-        // helper maps
-        std::unordered_map<int, int> entityIdToIndex;
-        std::unordered_map<int, int> indexToEntityId;
+        // order the components are sorted by when the registry is defragmented, entity id order if empty
+        std::function<bool(const T&, const T&)> order;
+
+        // false once a slot was added, removed or swapped since the last defragmentation
+        bool isSorted = true;
+
+        // changes every time slots are added, removed or moved, so a sort spread over several frames can tell if it missed changes
+        unsigned int layoutVersion = 0;
+
+        // paged sparse array, entity id -> index in the dense arrays
+        std::vector<std::unique_ptr<int[]>> sparse;
+
+        int* SparseSlot(int entityId) const {
+            const auto page = static_cast<size_t>(entityId / PAGE_SIZE);
+            if (page >= sparse.size() || !sparse[page]) {
+                return nullptr;
+            }
+            return &sparse[page][entityId % PAGE_SIZE];
+        }
+
+        int& AssureSparseSlot(int entityId) {
+            const auto page = static_cast<size_t>(entityId / PAGE_SIZE);
+            if (page >= sparse.size()) {
+                sparse.resize(page + 1);
+            }
+            if (!sparse[page]) {
+                sparse[page] = std::make_unique<int[]>(PAGE_SIZE);
+                std::fill(sparse[page].get(), sparse[page].get() + PAGE_SIZE, INVALID_INDEX);
+            }
+            return sparse[page][entityId % PAGE_SIZE];
+        }
+
+        // move the components to a new block of the given capacity
+        void Reallocate(int newCapacity) {
+            T* newData = static_cast<T*>(::operator new(sizeof(T) * newCapacity, std::align_val_t(alignof(T))));
+            for (int i = 0; i < size; i++) {
+                new (newData + i) T(std::move(data[i]));
+                data[i].~T();
+            }
+            ::operator delete(data, std::align_val_t(alignof(T)));
+            data = newData;
+            capacity = newCapacity;
+            entityIds.reserve(newCapacity);
+            versions.reserve(newCapacity);
+        }
+
+        // index of a new slot at the end of the dense arrays, growing the storage if it is full
+        int PushSlot(int entityId) {
+            if (size == capacity) {
+                Reserve(capacity == 0 ? PoolGrowthPolicy<T>::INITIAL_CAPACITY : PoolGrowthPolicy<T>::Grow(capacity));
+            }
+            // a component with an order may belong anywhere, the others stay sorted if appended in entity id order
+            if (order || (size > 0 && entityIds.back() > entityId)) {
+                isSorted = false;
+            }
+            layoutVersion++;
+            entityIds.push_back(entityId);
+            versions.push_back(NO_TICK);
+            return size++;
+        }
 
     public:
-        Pool(int capacity = 100) {
-            size = 0;
-            data.resize(capacity);
+        // no memory is allocated until the first component is added, unless a capacity is given
+        explicit Pool(int initialCapacity = 0) {
+            Reserve(initialCapacity);
         }
 
-        virtual ~Pool() = default;
+        virtual ~Pool() {
+            Clear();
+            ::operator delete(data, std::align_val_t(alignof(T)));
+        }
+
+        Pool(const Pool&) = delete;
+        Pool& operator =(const Pool&) = delete;
 
         bool IsEmpty() const {
             return size == 0;
         }
 
-        int GetSize() const {
+        int GetSize() const override {
             return size;
         }
 
-        void Resize(int n) {
-            data.resize(n);
+        int GetCapacity() const {
+            return capacity;
+        }
+
+        // the pool stamps the components accessed mutably with the value pointed by tick
+        void SetTickSource(const unsigned int* tick) {
+            this->tick = tick;
         }
 
+        // tick of the last mutable access of the component stored at a dense index
+        unsigned int GetVersion(int index) const {
+            return versions[index];
+        }
+
+        // make room for at least n components, so adding them does not grow the pool several times
+        void Reserve(int n) {
+            if (n > capacity) {
+                Reallocate(n);
+            }
+        }
+
+        // destroy every component, the storage is kept for reuse
         void Clear() {
-            data.clear();
+            for (int i = 0; i < size; i++) {
+                data[i].~T();
+            }
+            entityIds.clear();
+            versions.clear();
+            sparse.clear();
             size = 0;
+            isSorted = true;
+            layoutVersion++;
         }
 
-        void Add(T object) {
-            data.push_back(object);
+        bool Contains(int entityId) const override {
+            const int* slot = SparseSlot(entityId);
+            return slot && *slot != INVALID_INDEX;
         }
 
-        void Set(int entityId, T object) {
-            if (entityIdToIndex.find(entityId) != entityIdToIndex.end()) {
+        // dense index of the component of an entity, -1 if the entity has none
+        int IndexOf(int entityId) const override {
+            const int* slot = SparseSlot(entityId);
+            return slot ? *slot : INVALID_INDEX;
+        }
+
+        // exchange the position of two components in the dense arrays
+        void SwapIndices(int indexA, int indexB) override {
+            if (indexA == indexB) {
+                return;
+            }
+            isSorted = false;
+            layoutVersion++;
+            std::swap(data[indexA], data[indexB]);
+            std::swap(entityIds[indexA], entityIds[indexB]);
+            std::swap(versions[indexA], versions[indexB]);
+            *SparseSlot(entityIds[indexA]) = indexA;
+            *SparseSlot(entityIds[indexB]) = indexB;
+        }
+
+        void SetOrder(std::function<bool(const T&, const T&)> order) {
+            this->order = std::move(order);
+            isSorted = false;
+            layoutVersion++;
+        }
+
+        bool HasOrder() const override {
+            return static_cast<bool>(order);
+        }
+
+        bool IsSorted() const override {
+            return isSorted;
+        }
+
+        void MarkSorted() override {
+            isSorted = true;
+        }
+
+        unsigned int GetLayoutVersion() const override {
+            return layoutVersion;
+        }
+
+        // true if the component at a dense index is stored before the one at another:
+        // by the order of the pool, then by entity id
+        bool IsBefore(int indexA, int indexB) const override {
+            if (order) {
+                if (order(data[indexA], data[indexB])) {
+                    return true;
+                }
+                if (order(data[indexB], data[indexA])) {
+                    return false;
+                }
+            }
+            return entityIds[indexA] < entityIds[indexB];
+        }
+
+        // rearrange the slots starting at begin, so slot begin + i gets what was in slot indices[i]
+        void Permute(int begin, const std::vector<int>& indices) override {
+            layoutVersion++;
+            std::vector<T> components;
+            std::vector<int> permutedEntityIds;
+            std::vector<unsigned int> permutedVersions;
+            components.reserve(indices.size());
+            permutedEntityIds.reserve(indices.size());
+            permutedVersions.reserve(indices.size());
+            for (auto index : indices) {
+                components.push_back(std::move(data[index]));
+                permutedEntityIds.push_back(entityIds[index]);
+                permutedVersions.push_back(versions[index]);
+            }
+
+            for (int i = 0; i < static_cast<int>(indices.size()); i++) {
+                const int index = begin + i;
+                data[index] = std::move(components[i]);
+                entityIds[index] = permutedEntityIds[i];
+                versions[index] = permutedVersions[i];
+                *SparseSlot(entityIds[index]) = index;
+            }
+        }
+
+        // construct the component of an entity straight into the pool storage from its constructor arguments
+        template <typename ...TArgs>
+        T& Emplace(int entityId, TArgs&& ...args) {
+            int& index = AssureSparseSlot(entityId);
+            if (index != INVALID_INDEX) {
                 // if the element already exists, simply replace the component object
-                int index = entityIdToIndex[entityId];
-                data[index] = object;
-            } else {
-                // when adding a new object, keep track of entity ids and vector index 
-                int index = size;
-                entityIdToIndex.emplace(entityId, index);
-                indexToEntityId.emplace(index, entityId);
-                if (index >= data.capacity()) {
-                    // if necessary, resize current capacity
-                    data.resize(size * 2);
+                data[index] = T(std::forward<TArgs>(args)...);
+                if (order) {
+                    isSorted = false;
+                    layoutVersion++;
                 }
-                data[index] = object;
-                size++;
+            } else if (size == capacity) {
+                // growing the storage frees the memory the arguments may refer to, like a component of the same pool,
+                // so the object is built before the pool grows
+                T object(std::forward<TArgs>(args)...);
+                index = PushSlot(entityId);
+                new (data + index) T(std::move(object));
+            } else {
+                // when adding a new object, construct it in the first free slot and keep track of its entity id
+                index = PushSlot(entityId);
+                new (data + index) T(std::forward<TArgs>(args)...);
             }
+            Stamp(index);
+            return data[index];
+        }
+
+        void Set(int entityId, T object) {
+            Emplace(entityId, std::move(object));
         }
 
         void Remove(int entityId) {
-            // copy the last element to the deleted position to array packed
-            int indexOfRemoved = entityIdToIndex[entityId];
-            int indexOfLast = size - 1;
-            data[indexOfRemoved] = data[indexOfLast];
+            // an entity without a component has nothing to remove
+            int* slot = SparseSlot(entityId);
+            if (!slot || *slot == INVALID_INDEX) {
+                return;
+            }
 
-            // update the index-entity map to point to the correct elements
-            int entityIdOfLastElement = indexToEntityId[indexOfLast];
-            entityIdToIndex[entityIdOfLastElement] = indexOfRemoved;
-            indexToEntityId[indexOfRemoved] = entityIdOfLastElement;
+            // move the last element to the deleted position to keep the array packed
+            int& indexOfRemoved = *slot;
+            const int indexOfLast = size - 1;
+            const int entityIdOfLastElement = entityIds[indexOfLast];
+            layoutVersion++;
+            if (indexOfRemoved != indexOfLast) {
+                isSorted = false;
+                data[indexOfRemoved] = std::move(data[indexOfLast]);
+                entityIds[indexOfRemoved] = entityIdOfLastElement;
+                versions[indexOfRemoved] = versions[indexOfLast];
+            }
+            data[indexOfLast].~T();
+            entityIds.pop_back();
+            versions.pop_back();
 
-            entityIdToIndex.erase(entityId);
-            indexToEntityId.erase(indexOfLast);
+            // update the sparse array to point to the correct elements
+            *SparseSlot(entityIdOfLastElement) = indexOfRemoved;
+            indexOfRemoved = INVALID_INDEX;
 
             size--;
         }
 
         void RemoveEntityFromPool(int entityId) override {
-            if (entityIdToIndex.find(entityId) != entityIdToIndex.end()) {
+            if (Contains(entityId)) {
+                Remove(entityId);
+            }
+        }
+
+        // remove the components of a batch of entities that all have one
+        void RemoveEntitiesFromPool(const std::vector<int>& entityIds) override {
+            for (auto entityId : entityIds) {
                 Remove(entityId);
             }
         }
 
         T& Get(int entityId) {
-            int index = entityIdToIndex[entityId];
-            return static_cast<T&>(data[index]);
+            const int index = *SparseSlot(entityId);
+            Stamp(index);
+            return data[index];
+        }
+
+        const T& Get(int entityId) const {
+            return data[*SparseSlot(entityId)];
+        }
+
+        // entity id that owns the component stored at a dense index
+        int GetEntityId(int index) const override {
+            return entityIds[index];
+        }
+
+        const std::vector<int>& GetEntityIds() const {
+            return entityIds;
         }
 
         T& operator [](unsigned int index) {
+            Stamp(index);
+            return data[index];
+        }
+
+        const T& operator [](unsigned int index) const {
             return data[index];
         }
 };
 
+// immutable values repeated across many entities, like the texture and size of a sprite,
+// every distinct value of T is stored once and entities keep the small index of it in a Shared<T>
+// index 0 always holds a default constructed T, values are never freed
+// the values live in fixed size pages that never move, so reading one does not need the lock
+// the values are found by their std::hash, which T has to specialize, interning a known value only takes a shared lock
+template <typename T>
+class SharedPool {
+    private:
+        static constexpr int PAGE_SIZE = 1024;
+        static constexpr int MAX_PAGES = 1024;
+
+        std::shared_mutex mutex;
+        std::unique_ptr<T[]> pages[MAX_PAGES];
+        int size = 0;
+
+        // hash of a value -> its index, values with the same hash are told apart with ==
+        std::unordered_multimap<size_t, int> indicesPerHash;
+
+        int Find(const T& value, size_t hash) const {
+            auto range = indicesPerHash.equal_range(hash);
+            for (auto index = range.first; index != range.second; index++) {
+                if (Get(index->second) == value) {
+                    return index->second;
+                }
+            }
+            return -1;
+        }
+
+        SharedPool() {
+            pages[0] = std::make_unique<T[]>(PAGE_SIZE);
+            indicesPerHash.emplace(std::hash<T>()(pages[0][0]), 0);
+            size = 1;
+        }
+
+    public:
+        static SharedPool& Instance() {
+            static SharedPool pool;
+            return pool;
+        }
+
+        // index of the value, equal values get the same index
+        int Intern(const T& value) {
+            const size_t hash = std::hash<T>()(value);
+            {
+                // there are only a few distinct values, far fewer than the entities sharing them, so most are already known
+                std::shared_lock<std::shared_mutex> lock(mutex);
+                const int index = Find(value, hash);
+                if (index != -1) {
+                    return index;
+                }
+            }
+
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            const int index = Find(value, hash);
+            if (index != -1) {
+                return index;
+            }
+            if (size == PAGE_SIZE * MAX_PAGES) {
+                Logger::Err("No more shared values available, using the default one");
+                return 0;
+            }
+            if (!pages[size / PAGE_SIZE]) {
+                pages[size / PAGE_SIZE] = std::make_unique<T[]>(PAGE_SIZE);
+            }
+            pages[size / PAGE_SIZE][size % PAGE_SIZE] = value;
+            indicesPerHash.emplace(hash, size);
+            return size++;
+        }
+
+        const T& Get(int index) const {
+            return pages[index / PAGE_SIZE][index % PAGE_SIZE];
+        }
+};
+
+// handle to a value stored once in the SharedPool of its type, copying it copies the index only
+// building it interns the value, code that creates many entities with the same value can build it once and copy it
+template <typename T>
+class Shared {
+    private:
+        int index = 0;
+
+    public:
+        Shared() = default;
+        Shared(const T& value): index(SharedPool<T>::Instance().Intern(value)) {}
+
+        const T& Get() const {
+            return SharedPool<T>::Instance().Get(index);
+        }
+
+        const T& operator *() const { return Get(); }
+        const T* operator ->() const { return &Get(); }
+
+        // entities using the same value have the same index, so it can be used to group them
+        int GetIndex() const { return index; }
+
+        bool operator ==(const Shared& other) const { return index == other.index; }
+        bool operator !=(const Shared& other) const { return index != other.index; }
+        bool operator <(const Shared& other) const { return index < other.index; }
+};
+
+// terms of a view besides the required components:
+// Without<T> matches the entities that do not have a T, Optional<T> matches with or without a T
+// example: registry->View<TransformComponent, Without<KeyboardControlledComponent>, Optional<const SpriteComponent>>()
+template <typename T> struct Without {};
+template <typename T> struct Optional {};
+
+// how a term of a view filters the entities and what it passes to the callback
+template <typename TTerm>
+struct ViewTerm {
+    using Component = TTerm;
+    using Type = std::remove_const_t<TTerm>;
+    using Arguments = std::tuple<TTerm&>;
+    static constexpr bool IS_REQUIRED = true;
+    static constexpr bool IS_OPTIONAL = false;
+    static constexpr bool IS_EXCLUDED = false;
+};
+
+template <typename T>
+struct ViewTerm<Without<T>> {
+    using Component = T;
+    using Type = std::remove_const_t<T>;
+    using Arguments = std::tuple<>;
+    static constexpr bool IS_REQUIRED = false;
+    static constexpr bool IS_OPTIONAL = false;
+    static constexpr bool IS_EXCLUDED = true;
+};
+
+template <typename T>
+struct ViewTerm<Optional<T>> {
+    using Component = T;
+    using Type = std::remove_const_t<T>;
+    using Arguments = std::tuple<T*>;
+    static constexpr bool IS_REQUIRED = false;
+    static constexpr bool IS_OPTIONAL = true;
+    static constexpr bool IS_EXCLUDED = false;
+};
+
+// conditions on an entity, precomputed as masks so matching an entity is a few bit tests
+// the entity must have the components and not the Without<T> ones, and if tags or groups are given,
+// have one of the tags or belong to one of the groups
+// example: EntityFilter().With<HealthComponent>().WithTag("player").InGroup("enemies")
+class EntityFilter {
+    private:
+        Signature signature;
+        Signature excludedSignature;
+        TagMask tags;
+        GroupMask groups;
+
+        friend class Registry;
+
+    public:
+        template <typename ...TComponents> EntityFilter& With();
+        EntityFilter& WithTag(const std::string& tag);
+        EntityFilter& InGroup(const std::string& group);
+
+        bool Matches(Entity entity) const;
+};
+
+// a filter on a pair of entities, like the two sides of a collision, matching them in either order
+struct EntityPairFilter {
+    EntityFilter first;
+    EntityFilter second;
+
+    // true if one entity matches first and the other second, a is then the one matching first
+    bool Apply(Entity& a, Entity& b) const;
+};
+
+template <typename ...TComponents> class ComponentView;
+class CommandBuffer;
+class Prefab;
+
+// an archetype keeps the pools of a set of component types packed in lockstep:
+// the entities that have all of them occupy the first packedSize slots of every owned pool, in the same order,
+// so iterating them walks every owned pool sequentially
+// each pool can be owned by a single archetype
+struct Archetype {
+    Signature signature;
+    std::vector<int> componentIds;
+    int packedSize = 0;
+};
+
+// a merge sort of the slots of a pool that can stop after any amount of work and resume later,
+// so a large pool is sorted over several frames
+// the slots are not moved, the sort computes the order their entities should be stored in
+// it sorts entity ids rather than slots, so components added, removed or moved in the meantime do not make it stale,
+// an entity that left the pool is sorted last
+class IncrementalSort {
+    private:
+        static constexpr int RUN_SIZE = 32;
+
+        const IPool* pool = nullptr;
+        std::vector<int> indices;
+        std::vector<int> merged;
+
+        bool IsBefore(int entityIdA, int entityIdB) const {
+            const int indexA = pool->IndexOf(entityIdA);
+            const int indexB = pool->IndexOf(entityIdB);
+            if (indexA == -1 || indexB == -1) {
+                return indexB == -1 && indexA != -1;
+            }
+            return pool->IsBefore(indexA, indexB);
+        }
+
+        // size of the sorted runs, 0 until the first runs are sorted by insertion
+        int width = 0;
+
+        // start of the run being sorted or of the pair of runs being merged, and the cursors of the merge, -1 between pairs
+        int position = 0;
+        int left = 0;
+        int right = 0;
+        int out = -1;
+
+    public:
+        // start sorting the slots in [begin, end) of a pool
+        void Start(const IPool& pool, int begin, int end);
+
+        // sort for about maxWork comparisons, true once the indices are sorted
+        bool Advance(int maxWork);
+
+        // the entity ids of the slots, in the order they should be stored in once the sort is done
+        const std::vector<int>& GetEntityIds() const {
+            return indices;
+        }
+};
+
+// callback receiving the batch of entities whose component of a certain type was added, replaced or removed
+typedef std::function<void(const std::vector<Entity>& entities)> ComponentObserver;
+
+// observers of a component type, and the changes of that component waiting to be reported to them
+struct ComponentObservers {
+    enum Change: char {
+        ADDED = 1,
+        REPLACED = 2,
+        REMOVED = 4
+    };
+
+    std::vector<ComponentObserver> onAdd;
+    std::vector<ComponentObserver> onReplace;
+    std::vector<ComponentObserver> onRemove;
+
+    // net change of each entity since the last Update
+    // the handles are taken when the entities first change, so a killed entity is reported with its own handle
+    // vector index of pendingChanges = entity id
+    std::vector<Entity> changedEntities;
+    std::vector<char> pendingChanges;
+};
+
 // the registry manages the creationg and destruction of entites, add systems and components
 class Registry {
     private:
@@ -195,35 +827,166 @@ class Registry {
         // vector of component pools, each pool contains all the data for a certain component type
         // vector index = component type id
         // pool index = entity id
-        std::vector<std::shared_ptr<IPool>> componentPools;
+        // the pools of the component types in ComponentTypes always have a slot
+        std::vector<std::unique_ptr<IPool>> componentPools;
 
         // vector of component signature per entity
         // vector index = entity id
         std::vector<Signature> entityComponentSignatures;
 
-        std::unordered_map<std::type_index, std::shared_ptr<System>> systems;
+        // vector index = system type id, nullptr if the system was not added
+        // the systems in SystemTypes always have a slot
+        std::vector<std::unique_ptr<System>> systems;
+
+        // systems each entity currently belongs to, so killing an entity only visits those
+        // vector index = entity id
+        std::vector<std::vector<System*>> systemsPerEntity;
+
+        // systems whose signature requires or excludes a component type, so a signature change only rechecks those
+        // vector index = component type id
+        std::vector<std::vector<System*>> systemsPerComponent;
+
+        // incremented by every Update and BeginChangeQuery, stamped into the components accessed mutably
+        unsigned int currentTick = 1;
+
+        // observers of each component type, nullptr if the component type has none
+        // vector index = component type id
+        std::vector<std::unique_ptr<ComponentObservers>> componentObservers;
 
-        // set of enetities that are to be added or deleted
-        std::set<Entity> entitiesToBeAdded;
-        std::set<Entity> entitiesToBeKilled;
+        // components added to or removed from live entities since the last Update
+        // vector index of pendingSignatureChanges = entity id
+        std::vector<int> entitiesWithSignatureChanges;
+        std::vector<Signature> pendingSignatureChanges;
 
-        // entity tags (one tag name per entity)
-        std::unordered_map<std::string, Entity> entitiyPerTag;
-        std::unordered_map<int, std::string> tagPerEntity;
+        // list of enetities that are to be added or deleted
+        std::vector<Entity> entitiesToBeAdded;
+        std::vector<Entity> entitiesToBeKilled;
 
-        // entity groups (a set of entities per group name)
-        std::unordered_map<std::string, std::set<Entity>> entitiesPerGroup;
-        std::unordered_map<int, std::string> groupPerEntity;
+        // flags the entities already in entitiesToBeKilled, so killing twice is harmless
+        // vector index = entity id
+        std::vector<char> isEntityToBeKilled;
+
+        // generation of the entity currently using each id, incremented when a killed entity frees it
+        // vector index = entity id
+        std::vector<uint32_t> entityGenerations;
+
+        // systems running on worker threads can kill entities at the same time
+        std::mutex entitiesToBeKilledMutex;
+
+        // command buffers waiting to be played back, with the key that orders them
+        std::vector<std::pair<int, CommandBuffer>> submittedCommandBuffers;
+        std::mutex submittedCommandBuffersMutex;
+
+        // entity tags, a tag names a single entity
+        // vector index of entityPerTag = tag id, -1 if no entity has the tag
+        // vector index of tagsPerEntity = entity id
+        std::vector<int> entityPerTag;
+        std::vector<TagMask> tagsPerEntity;
+
+        // entity groups
+        // vector index = entity id
+        std::vector<GroupMask> groupsPerEntity;
 
         // list of free entity ids that were previously removed
         std::deque<int> freeIds;
 
+        // archetypes packing the pools of component sets that are frequently iterated together
+        // vector index of componentArchetypes = component type id, -1 if the pool is not owned
+        std::vector<std::unique_ptr<Archetype>> archetypes;
+        std::vector<int> componentArchetypes;
+
+        // move an entity inside or outside the packed region of the archetype that owns a component type
+        void PackEntity(int componentId, int entityId);
+        void UnpackEntity(int componentId, int entityId);
+        const Archetype* FindArchetype(const Signature& signature) const;
+
+        // reserve ids for a batch of entities, growing the per entity arrays once
+        std::vector<Entity> CreateEntities(int count);
+
+        // match each entity with the systems interested in it,
+        // consecutive entities with the same signature reuse the systems matched for the previous one
+        void AddEntitiesToSystems(const std::vector<Entity>& entities);
+
+        // queue the change of a component bit of an entity, the systems are updated in the next Update
+        void QueueSignatureChange(int entityId, int componentId);
+
+        // add or remove the entities with queued signature changes to or from the systems that require the changed components
+        void ApplySignatureChanges();
+
+        // remove the entities waiting to be killed, grouped so each pool and system is visited once
+        void RemoveKilledEntities();
+
+        // the handle refers to the entity using its id, alive or waiting to be killed,
+        // and not to a killed entity or to the null entity
+        bool IsValid(Entity entity) const;
+
+        // a sort Defragment has to do: the packed region of an archetype, permuting every owned pool in lockstep,
+        // or the slots of a single pool, outside the packed region if the pool is owned
+        struct DefragmentJob {
+            // the pools permuted by the sort, the first one gives the order
+            std::vector<int> componentIds;
+            int archetypeIndex;
+            bool isPackedRegion;
+
+            // layout versions of the pools when the sort started, a pool that changed since is not marked sorted,
+            // neither is a pool whose packed region changed while an earlier job sorted it
+            std::vector<unsigned int> layoutVersions;
+            bool isStale;
+        };
+
+        // the sorts left to finish the archetype or pool being defragmented, the first one is in progress
+        // a sort in progress carries on when components are added or removed, like projectiles spawning and dying every frame,
+        // the entities that entered its region meanwhile are left after the sorted ones for the next pass
+        std::deque<DefragmentJob> defragmentJobs;
+        IncrementalSort defragmentSort;
+        bool isDefragmentSortStarted = false;
+
+        // the step Defragment resumes from: the archetypes, then the pools, then the systems
+        int nextDefragmentStep = 0;
+
+        // queue the sorts of the next archetype or pool out of order, or sort the entities of the next system out of order,
+        // false if everything is sorted
+        bool QueueDefragmentJobs();
+
+        // keep systemsPerComponent in sync with the systems
+        void IndexSystem(System* system);
+        void UnindexSystem(System* system);
+
+        // remember a change of a component for its observers, if it has any
+        bool IsObserved(int componentId) const;
+        void RecordComponentChange(int componentId, int entityId, ComponentObservers::Change change);
+
+        // report the net changes since the last Update to the observers
+        void NotifyObservers();
+
+        ComponentObservers& AssureObservers(int componentId);
+
+        template <typename TComponent>
+        static void InstantiateComponents(Registry& registry, const void* prototype, const std::vector<Entity>& entities);
+
+        // add or replace a component without logging it, for the batch paths
+        template <typename TComponent, typename ...TArgs> bool EmplaceComponent(Entity entity, TArgs&& ...args);
+
+        template <typename ...TComponents> friend class ComponentView;
+        friend class Prefab;
+        friend class CommandBuffer;
+
+        // typed access to a component pool, nullptr if the component type was never added
+        template <typename TComponent> Pool<TComponent>* GetPool() const;
+        template <typename TComponent> Pool<TComponent>* AssurePool();
+
     public:
         Registry() {
+            assert(!Entity::registry && "only one registry can be alive at a time");
+            Entity::registry = this;
+            componentPools.resize(ComponentTypes::SIZE);
+            componentArchetypes.resize(ComponentTypes::SIZE, -1);
+            systems.resize(SystemTypes::SIZE);
             Logger::Log("Registry constructor called");
         };
 
         ~Registry() {
+            Entity::registry = nullptr;
             Logger::Log("Registry destructor called");
         }
 
@@ -234,117 +997,749 @@ class Registry {
         Entity CreateEntity();
         void KillEntity(Entity entity);
 
+        // handle of the entity currently using an id
+        Entity GetEntity(int entityId) const {
+            return Entity(entityId, entityGenerations[entityId]);
+        }
+
+        // an entity is alive until it is killed, its handle then goes stale once Update frees its id
+        bool IsAlive(Entity entity) const;
+
+        // create count entities with a copy of every component of a prefab, in one batch:
+        // ids and pool capacity are reserved up front and the entities join their systems together in the next Update
+        // the initializer is called with each new entity and its index in the batch, to customize its components
+        // example: registry->Instantiate(tilePrefab, numTiles, [](Entity tile, int index) {...});
+        std::vector<Entity> Instantiate(const Prefab& prefab, int count);
+        template <typename TFunc> std::vector<Entity> Instantiate(const Prefab& prefab, int count, TFunc&& initializer);
+
+        // hand over the structural changes recorded in a command buffer, they are played back in the next Update
+        // buffers are played back in increasing sortKey order, and in submission order for equal keys,
+        // so buffers recorded by parallel jobs should use a key derived from their work range, not from the thread
+        // can be called from any thread
+        void Submit(CommandBuffer&& commandBuffer, int sortKey = 0);
+
+        // tag and group names are interned into small ids shared by every registry, -1 once all ids are taken
+        // systems can look their ids up once, then a membership check is a single bit test
+        static int GetTagId(const std::string& tag);
+        static int GetGroupId(const std::string& group);
+
+        // the id of a name without interning it, -1 if it was never interned,
+        // queries use them so looking up a name no entity has does not take one of the ids
+        static int FindTagId(const std::string& tag);
+        static int FindGroupId(const std::string& group);
+
         // tag management
         void TagEntity(Entity entity, const std::string& tag);
+        void TagEntity(Entity entity, int tagId);
         bool EntityHasTag(Entity entity, const std::string& tag) const;
+        bool EntityHasTag(Entity entity, int tagId) const;
         Entity GetEntityByTag(const std::string& tag) const;
         void RemoveEntityTag(Entity entity);
 
         // group management
         void GroupEntity(Entity entity, const std::string& group);
+        void GroupEntity(Entity entity, int groupId);
         bool EntityBelongsToGroup(Entity entity, const std::string& group) const;
+        bool EntityBelongsToGroup(Entity entity, int groupId) const;
         std::vector<Entity> GetEntitesByGroup(const std::string& group) const;
         void RemoveEntityGroup(Entity entity);
 
+        // components, tags and groups at once, see EntityFilter
+        bool EntityMatches(Entity entity, const EntityFilter& filter) const;
+
         // component management
         template <typename TComponent, typename ...TArgs> void AddComponent(Entity entity, TArgs&& ...args);
         template <typename TComponent> void RemoveComponent(Entity entity);
         template <typename TComponent> bool HasComponent(Entity entity) const;
         template <typename TComponent> TComponent& GetComponent(Entity entity) const;
 
+        // change tracking, a const component type (GetComponent<const TransformComponent>) is read without marking it as changed
+        // components are stamped with the current tick when they are added or accessed mutably
+        // a reader takes a snapshot with BeginChangeQuery, which starts a new tick, so every change made after it,
+        // even in the same frame, is stamped with a later tick and reported by the next query since the snapshot
+        // it must be called on the main thread, not while systems are updating
+        // example: lastTick = registry->BeginChangeQuery(); ... registry->HasComponentChangedSince<T>(entity, lastTick)
+        unsigned int BeginChangeQuery();
+        template <typename TComponent> bool HasComponentChangedSince(Entity entity, unsigned int tick) const;
+
+        // invoke func(Entity, const TComponent&) for every entity whose component changed after the given tick
+        // example: registry->EachChangedSince<TransformComponent>(lastTick, [](Entity entity, const TransformComponent& transform) {...});
+        template <typename TComponent, typename TFunc> void EachChangedSince(unsigned int tick, TFunc&& func) const;
+
+        // observers of a component type, called at the end of Update with the entities whose component
+        // was added, replaced (added again while present) or removed (including by killing the entity) since the previous Update
+        // only the net change of a frame is reported: a component added then removed is not reported at all,
+        // one removed then added again is reported as replaced
+        // the added and replaced components can be read in the observer, the removed ones are already gone
+        // example: registry->OnAdd<BoxColliderComponent>([](const std::vector<Entity>& entities) {...});
+        template <typename TComponent> void OnAdd(ComponentObserver observer);
+        template <typename TComponent> void OnReplace(ComponentObserver observer);
+        template <typename TComponent> void OnRemove(ComponentObserver observer);
+
         // system management
         template <typename TSystem, typename ...TArgs> void AddSystem(TArgs&& ...args);
         template <typename TSystem> void RemoveSystem();
         template <typename TSystem> bool HasSystem() const;
         template <typename TSystem> TSystem& GetSystem() const;
 
+        // iterate all entities that have every one of the given components, the terms can also be Without<T> and Optional<T>
+        // components requested as const are not marked as changed
+        // example: registry->View<TransformComponent, const RigidBodyComponent>().Each([](Entity entity, auto& transform, auto& rigidBody) {...});
+        template <typename ...TComponents> ComponentView<TComponents...> View();
+
+        // keep the pools of the given component types packed in the same entity order
+        // views that ask for all of these components will then read the owned pools sequentially
+        // example: registry->AddArchetype<TransformComponent, SpriteComponent>();
+        template <typename ...TComponents> void AddArchetype();
+
+        // sort the components of a type by a key when the pools are defragmented, like the z index of sprites
+        // example: registry->SetComponentOrder<SpriteComponent>([](const auto& a, const auto& b) { return a.data->zIndex < b.data->zIndex; });
+        template <typename TComponent> void SetComponentOrder(std::function<bool(const TComponent&, const TComponent&)> order);
+
+        // removals scramble the order of the pools, this puts every pool back in entity id order, or in the order set for it,
+        // the owned pools of an archetype move in lockstep, and the entities of every system are sorted by id,
+        // so the loops of the systems read memory sequentially again
+        // only the pools and systems that changed since they were last sorted are visited,
+        // the sorts are split in small steps, no step starts once the budget is spent, and the next call resumes where this one stopped
+        // it is meant for the idle time of a frame, and must not run while systems are updating
+        void Defragment(int budgetMillisecs);
+
         // check the component signature of an entity and add the entity to systems that are interested in it
         void AddEntityToSystems(Entity entity);
         void RemoveEntityFromSystems(Entity entity);
 
 };
 
+// a set of components described once, to create many entities with the same components
+// example:
+//     Prefab tilePrefab;
+//     tilePrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(mapScale, mapScale), 0.0);
+//     tilePrefab.AddComponent<SpriteComponent>(mapTextureAssetId, tileSize, tileSize, 0);
+//     registry->Instantiate(tilePrefab, numTiles);
+class Prefab {
+    private:
+        struct PrefabComponent {
+            int componentId;
+
+            // component object every instance is copied from
+            std::shared_ptr<const void> prototype;
+
+            // copy the prototype into the pool, for every entity of a batch
+            void (*instantiate)(Registry& registry, const void* prototype, const std::vector<Entity>& entities);
+        };
+
+        std::vector<PrefabComponent> components;
+        Signature signature;
+        int groupId = -1;
+
+        friend class Registry;
+
+    public:
+        // adding a component type twice replaces its prototype
+        template <typename TComponent, typename ...TArgs> void AddComponent(TArgs&& ...args);
+
+        // every instance joins the group
+        void Group(const std::string& group);
+
+        const Signature& GetSignature() const;
+};
+
+// handle of an entity created by a command buffer, it becomes a real entity when the buffer is played back
+struct DeferredEntity {
+    int index;
+};
+
+// records structural changes (entity creation, instantiation and killing, component additions and removals, tags and groups)
+// without touching the registry, so every thread can record into its own buffer without locks
+// components are constructed right away inside a linear arena of fixed size blocks, and moved into their pools on playback
+// example:
+//     CommandBuffer commandBuffer;
+//     DeferredEntity projectile = commandBuffer.CreateEntity();
+//     commandBuffer.AddComponent<TransformComponent>(projectile, position, glm::vec2(1.0, 1.0), 0.0);
+//     registry->Submit(std::move(commandBuffer));
+class CommandBuffer {
+    private:
+        static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+        enum class CommandType {
+            CreateEntity,
+            Instantiate,
+            KillEntity,
+            AddComponent,
+            RemoveComponent,
+            TagEntity,
+            GroupEntity
+        };
+
+        struct Command {
+            CommandType type;
+
+            // entity, or index of an entity created by this buffer (-1 if the entity is not deferred)
+            Entity entity;
+            int deferredIndex = -1;
+
+            // component object stored in the arena, or interned id of the tag or group, or prefab of the entity
+            void* component = nullptr;
+            int nameId = -1;
+            const Prefab* prefab = nullptr;
+
+            // type erased operations on the component
+            void (*addComponent)(Registry& registry, Entity entity, void* component) = nullptr;
+            void (*removeComponent)(Registry& registry, Entity entity) = nullptr;
+            void (*destroyComponent)(void* component) = nullptr;
+        };
+
+        std::vector<Command> commands;
+        int numDeferredEntities = 0;
+
+        // linear arena, objects are never moved once constructed
+        std::vector<std::unique_ptr<unsigned char[]>> blocks;
+        size_t blockOffset = BLOCK_SIZE;
+
+        void* Allocate(size_t size, size_t alignment);
+        void Record(CommandType type, Entity entity);
+        void Record(CommandType type, DeferredEntity entity);
+        void DestroyComponents();
+
+        template <typename TComponent>
+        static void AddBufferedComponent(Registry& registry, Entity entity, void* component);
+
+        template <typename TComponent>
+        static void RemoveBufferedComponent(Registry& registry, Entity entity);
+
+        template <typename TComponent>
+        static void DestroyBufferedComponent(void* component) {
+            static_cast<TComponent*>(component)->~TComponent();
+        }
+
+        template <typename TComponent, typename TEntity, typename ...TArgs>
+        void RecordAddComponent(TEntity entity, TArgs&& ...args);
+
+    public:
+        CommandBuffer() = default;
+        CommandBuffer(CommandBuffer&& other);
+        CommandBuffer& operator =(CommandBuffer&& other);
+        ~CommandBuffer();
+
+        CommandBuffer(const CommandBuffer&) = delete;
+        CommandBuffer& operator =(const CommandBuffer&) = delete;
+
+        bool IsEmpty() const;
+
+        DeferredEntity CreateEntity();
+        void KillEntity(Entity entity);
+
+        // create an entity with a copy of every component of a prefab, components added to it afterwards replace the copies
+        // the instances of a prefab are created in one batch on playback, so the prefab must outlive the buffer,
+        // like a prefab kept by the system recording it
+        DeferredEntity Instantiate(const Prefab& prefab);
+
+        void TagEntity(Entity entity, const std::string& tag);
+        void TagEntity(DeferredEntity entity, const std::string& tag);
+        void GroupEntity(Entity entity, const std::string& group);
+        void GroupEntity(DeferredEntity entity, const std::string& group);
+
+        // with the id from Registry::GetTagId or GetGroupId cached by the caller, recording takes no lock
+        void TagEntity(Entity entity, int tagId);
+        void TagEntity(DeferredEntity entity, int tagId);
+        void GroupEntity(Entity entity, int groupId);
+        void GroupEntity(DeferredEntity entity, int groupId);
+
+        template <typename TComponent, typename ...TArgs> void AddComponent(Entity entity, TArgs&& ...args);
+        template <typename TComponent, typename ...TArgs> void AddComponent(DeferredEntity entity, TArgs&& ...args);
+        template <typename TComponent> void RemoveComponent(Entity entity);
+
+        // apply all the recorded commands in order and clear the buffer
+        void Playback(Registry& registry);
+};
+
+// a view over all the entities that have a given set of components
+// it walks the packed entity array of the smallest pool and checks the other components through the
+// entity signature, handing out references straight into the pools without copying entities or components
+// when an archetype owns some of the requested components and its packed region is the smallest candidate,
+// the view walks that region instead and reads the owned pools by index, sequentially
+// the packed array is iterated backwards, so removing the current entity's components inside the loop is safe
+// const component types are read through the const accessors of their pools, so they are not marked as changed
+// Without<T> and Optional<T> terms are checked through the entity signature as well, see ViewTerm
+template <typename ...TComponents>
+class ComponentView {
+    private:
+        Registry* registry;
+        std::tuple<Pool<typename ViewTerm<TComponents>::Type>*...> pools;
+        const std::vector<int>* entityIds = nullptr;
+        int size = 0;
+        Signature signature;
+        Signature excludedSignature;
+
+        // components read by dense index, because the view walks the packed region of their archetype
+        Signature ownedSignature;
+
+        bool IsMatch(int entityId) const {
+            const auto& entityComponentSignature = registry->entityComponentSignatures[entityId];
+            return (entityComponentSignature & signature) == signature && (entityComponentSignature & excludedSignature).none();
+        }
+
+        template <typename TComponent>
+        TComponent& GetComponent(int index, int entityId) const {
+            using TPool = std::conditional_t<std::is_const_v<TComponent>, const Pool<std::remove_const_t<TComponent>>, Pool<TComponent>>;
+            TPool* pool = std::get<Pool<std::remove_const_t<TComponent>>*>(pools);
+            if (ownedSignature.test(Component<std::remove_const_t<TComponent>>::GetId())) {
+                return (*pool)[index];
+            }
+            return pool->Get(entityId);
+        }
+
+        // the arguments a term passes to the callback, as a tuple
+        template <typename TTerm>
+        typename ViewTerm<TTerm>::Arguments GetArguments(int index, int entityId) const {
+            if constexpr (ViewTerm<TTerm>::IS_REQUIRED) {
+                return typename ViewTerm<TTerm>::Arguments(GetComponent<TTerm>(index, entityId));
+            } else if constexpr (ViewTerm<TTerm>::IS_OPTIONAL) {
+                using TComponent = typename ViewTerm<TTerm>::Component;
+                using TPool = std::conditional_t<std::is_const_v<TComponent>, const Pool<std::remove_const_t<TComponent>>, Pool<TComponent>>;
+                TPool* pool = std::get<Pool<std::remove_const_t<TComponent>>*>(pools);
+                const int componentIndex = pool ? pool->IndexOf(entityId) : -1;
+                return typename ViewTerm<TTerm>::Arguments(componentIndex == -1 ? nullptr : &(*pool)[componentIndex]);
+            } else {
+                return typename ViewTerm<TTerm>::Arguments();
+            }
+        }
+
+        auto GetValue(int index, int entityId) const {
+            return std::tuple_cat(std::tuple<Entity>(registry->GetEntity(entityId)), GetArguments<TComponents>(index, entityId)...);
+        }
+
+    public:
+        class Iterator {
+            private:
+                const ComponentView* view;
+                int index;
+
+                void SkipMismatches() {
+                    while (index >= 0 && !view->IsMatch((*view->entityIds)[index])) {
+                        index--;
+                    }
+                }
+
+            public:
+                Iterator(const ComponentView* view, int index): view(view), index(index) {
+                    SkipMismatches();
+                }
+
+                // the entity, then a reference for every required component and a pointer for every optional one
+                auto operator *() const {
+                    return view->GetValue(index, (*view->entityIds)[index]);
+                }
+
+                Iterator& operator ++() {
+                    index--;
+                    SkipMismatches();
+                    return *this;
+                }
+
+                bool operator ==(const Iterator& other) const { return index == other.index; }
+                bool operator !=(const Iterator& other) const { return index != other.index; }
+        };
+
+        ComponentView(Registry* registry, const Archetype* archetype, Pool<typename ViewTerm<TComponents>::Type>*... componentPools): registry(registry), pools(componentPools...) {
+            static_assert((ViewTerm<TComponents>::IS_REQUIRED || ...), "a view needs at least one required component");
+
+            ((ViewTerm<TComponents>::IS_REQUIRED ? signature.set(Component<typename ViewTerm<TComponents>::Type>::GetId()) : signature), ...);
+            ((ViewTerm<TComponents>::IS_EXCLUDED ? excludedSignature.set(Component<typename ViewTerm<TComponents>::Type>::GetId()) : excludedSignature), ...);
+
+            // a required component type that was never added means no entity can match
+            if ((((componentPools == nullptr) && ViewTerm<TComponents>::IS_REQUIRED) || ...)) {
+                return;
+            }
+
+            // drive the iteration with the smallest required pool
+            size = -1;
+            auto considerPool = [this](const auto* pool, bool isRequired) {
+                if (isRequired && (size < 0 || pool->GetSize() < size)) {
+                    size = pool->GetSize();
+                    entityIds = &pool->GetEntityIds();
+                }
+            };
+            (considerPool(componentPools, ViewTerm<TComponents>::IS_REQUIRED), ...);
+
+            // or with the packed region of the archetype, if it is not larger
+            if (archetype && archetype->packedSize <= size) {
+                size = archetype->packedSize;
+                ownedSignature = archetype->signature;
+                auto considerOwnedPool = [this](const auto* pool, int componentId) {
+                    if (ownedSignature.test(componentId)) {
+                        entityIds = &pool->GetEntityIds();
+                    }
+                };
+                (considerOwnedPool(componentPools, Component<typename ViewTerm<TComponents>::Type>::GetId()), ...);
+            }
+        }
+
+        Iterator begin() const {
+            return Iterator(this, size - 1);
+        }
+
+        Iterator end() const {
+            return Iterator(this, -1);
+        }
+
+        // number of entities in the driving pool, an upper bound of the number of matches
+        int SizeHint() const {
+            return size;
+        }
+
+        // invoke func(Entity, TComponents&...) for every matching entity,
+        // Without<T> terms pass no argument, Optional<T> terms pass a T* that is nullptr if the entity has no T
+        template <typename TFunc>
+        void Each(TFunc&& func) const {
+            EachInRange(0, size, func);
+        }
+
+        // same as Each, restricted to the slots [begin, end) of the driving array, with end <= SizeHint()
+        // disjoint ranges can be processed from different threads
+        template <typename TFunc>
+        void EachInRange(int begin, int end, TFunc&& func) const {
+            for (int index = end - 1; index >= begin; index--) {
+                const int entityId = (*entityIds)[index];
+                if (IsMatch(entityId)) {
+                    std::apply(func, GetValue(index, entityId));
+                }
+            }
+        }
+};
+
+template <typename TComponent>
+void System::RequireComponent(ComponentAccess access) {
+    using TType = typename ViewTerm<TComponent>::Type;
+    if constexpr (ViewTerm<TComponent>::IS_EXCLUDED) {
+        ExcludeComponent<TType>();
+    } else {
+        if constexpr (ViewTerm<TComponent>::IS_REQUIRED) {
+            componentSignature.set(Component<TType>::GetId());
+        }
+        AccessComponent<TType>(access);
+    }
+}
+
 template <typename TComponent>
-void System::RequireComponent() {
+void System::ExcludeComponent() {
+    excludedSignature.set(Component<TComponent>::GetId());
+}
+
+template <typename TComponent>
+void System::AccessComponent(ComponentAccess access) {
     const auto componentId = Component<TComponent>::GetId();
-    componentSignature.set(componentId);
+    readSignature.set(componentId);
+    if (access == ComponentAccess::ReadWrite) {
+        writeSignature.set(componentId);
+    }
 }
 
 template <typename TSystem, typename ...TArgs>
 void Registry::AddSystem(TArgs&& ...args) {
-    std::shared_ptr<TSystem> newSystem = std::make_shared<TSystem>(std::forward<TArgs>(args)...);
-    systems.insert(std::make_pair(std::type_index(typeid(TSystem)), newSystem));
+    const auto systemId = SystemType<TSystem>::GetId();
+    if (systemId >= static_cast<int>(systems.size())) {
+        systems.resize(systemId + 1);
+    }
+
+    // like the map the systems were kept in, a system that was added already is kept
+    if (systems[systemId]) {
+        return;
+    }
+    systems[systemId] = std::make_unique<TSystem>(std::forward<TArgs>(args)...);
+    IndexSystem(systems[systemId].get());
 }
 
 template <typename TSystem>
 void Registry::RemoveSystem() {
-    auto system = systems.find(std::type_index(typeid(TSystem)));
-    systems.erase(system);
+    if (!HasSystem<TSystem>()) {
+        return;
+    }
+    auto& system = systems[SystemType<TSystem>::GetId()];
+
+    // forget the membership of all entities that were in the system
+    for (auto entity : system->GetSystemEntities()) {
+        auto& entitySystems = systemsPerEntity[entity.GetId()];
+        entitySystems.erase(std::remove(entitySystems.begin(), entitySystems.end(), system.get()), entitySystems.end());
+    }
+
+    UnindexSystem(system.get());
+    system.reset();
 }
 
 template <typename TSystem>
 bool Registry::HasSystem() const {
-    return systems.find(std::type_index(typeid(TSystem))) != systems.end();
+    const auto systemId = SystemType<TSystem>::GetId();
+    return systemId < static_cast<int>(systems.size()) && systems[systemId];
 }
 
 template <typename TSystem>
 TSystem& Registry::GetSystem() const {
-    auto system = systems.find(std::type_index(typeid(TSystem)));
-    return *(std::static_pointer_cast<TSystem>(system->second));
+    return static_cast<TSystem&>(*systems[SystemType<TSystem>::GetId()]);
 }
 
 template <typename TComponent, typename ...TArgs>
 void Registry::AddComponent(Entity entity, TArgs&& ...args) {
-    const auto componentId = Component<TComponent>::GetId();
-    const auto entityId = entity.GetId();
-
-    if (componentId >= static_cast<int>(componentPools.size())) {
-        componentPools.resize(componentId + 1, nullptr);
+    if (EmplaceComponent<TComponent>(entity, std::forward<TArgs>(args)...) && Logger::isEnabled) {
+        Logger::Log("Component id = " + std::to_string(Component<TComponent>::GetId()) + " was added to entity id " + std::to_string(entity.GetId()));
     }
+}
 
-    if (!componentPools[componentId]) {
-        std::shared_ptr<Pool<TComponent>> newComponentPool = std::make_shared<Pool<TComponent>>();
-        componentPools[componentId] = newComponentPool;
+template <typename TComponent, typename ...TArgs>
+bool Registry::EmplaceComponent(Entity entity, TArgs&& ...args) {
+    if (!IsValid(entity)) {
+        Logger::Err("Cannot add a component to an entity that does not exist");
+        return false;
     }
 
-    std::shared_ptr<Pool<TComponent>> componentPool = std::static_pointer_cast<Pool<TComponent>>(componentPools[componentId]);
+    const auto componentId = Component<TComponent>::GetId();
+    const auto entityId = entity.GetId();
 
-    TComponent newComponent(std::forward<TArgs>(args)...);
+    Pool<TComponent>* componentPool = AssurePool<TComponent>();
 
-    componentPool->Set(entityId, newComponent);
+    if (IsObserved(componentId)) {
+        RecordComponentChange(componentId, entityId, componentPool->Contains(entityId) ? ComponentObservers::REPLACED : ComponentObservers::ADDED);
+    }
+
+    componentPool->Emplace(entityId, std::forward<TArgs>(args)...);
 
     entityComponentSignatures[entityId].set(componentId);
+    QueueSignatureChange(entityId, componentId);
+
+    if (componentArchetypes[componentId] != -1) {
+        PackEntity(componentId, entityId);
+    }
 
-    Logger::Log("Component id = " + std::to_string(componentId) + " was added to entity id " + std::to_string(entityId));
+    return true;
 }
 
 template <typename TComponent>
 void Registry::RemoveComponent(Entity entity) {
+    if (!HasComponent<TComponent>(entity)) {
+        return;
+    }
+
     const auto componentId = Component<TComponent>::GetId();
     const auto entityId = entity.GetId();
 
+    if (componentArchetypes[componentId] != -1) {
+        UnpackEntity(componentId, entityId);
+    }
+
     // remove the component from the component list for that entity
-    std::shared_ptr<Pool<TComponent>> componentPool = std::static_pointer_cast<Pool<TComponent>>(componentPools[componentId]);
-    componentPool->Remove(entityId);
+    GetPool<TComponent>()->Remove(entityId);
 
     entityComponentSignatures[entityId].set(componentId, false);
+    QueueSignatureChange(entityId, componentId);
+
+    if (IsObserved(componentId)) {
+        RecordComponentChange(componentId, entityId, ComponentObservers::REMOVED);
+    }
 
-    Logger::Log("Component id = " + std::to_string(componentId) + " was removed from entity id " + std::to_string(entityId));
+    if (Logger::isEnabled) {
+        Logger::Log("Component id = " + std::to_string(componentId) + " was removed from entity id " + std::to_string(entityId));
+    }
 }
 
 template <typename TComponent>
 bool Registry::HasComponent(Entity entity) const {
 	const auto componentId = Component<TComponent>::GetId();
 	const auto entityId = entity.GetId();
-	return entityComponentSignatures[entityId].test(componentId);
+	return IsValid(entity) && entityComponentSignatures[entityId].test(componentId);
 }
 
 template <typename TComponent>
 TComponent& Registry::GetComponent(Entity entity) const {
+    if constexpr (std::is_const_v<TComponent>) {
+        return std::as_const(*GetPool<std::remove_const_t<TComponent>>()).Get(entity.GetId());
+    } else {
+        return GetPool<TComponent>()->Get(entity.GetId());
+    }
+}
+
+template <typename TComponent>
+bool Registry::HasComponentChangedSince(Entity entity, unsigned int tick) const {
+    const Pool<TComponent>* componentPool = GetPool<TComponent>();
+    if (!IsValid(entity) || !componentPool || !componentPool->Contains(entity.GetId())) {
+        return false;
+    }
+    return componentPool->GetVersion(componentPool->IndexOf(entity.GetId())) > tick;
+}
+
+template <typename TComponent>
+void Registry::OnAdd(ComponentObserver observer) {
+    AssureObservers(Component<TComponent>::GetId()).onAdd.push_back(std::move(observer));
+}
+
+template <typename TComponent>
+void Registry::OnReplace(ComponentObserver observer) {
+    AssureObservers(Component<TComponent>::GetId()).onReplace.push_back(std::move(observer));
+}
+
+template <typename TComponent>
+void Registry::OnRemove(ComponentObserver observer) {
+    AssureObservers(Component<TComponent>::GetId()).onRemove.push_back(std::move(observer));
+}
+
+template <typename TComponent, typename TFunc>
+void Registry::EachChangedSince(unsigned int tick, TFunc&& func) const {
+    const Pool<TComponent>* componentPool = GetPool<TComponent>();
+    if (!componentPool) {
+        return;
+    }
+    for (int index = componentPool->GetSize() - 1; index >= 0; index--) {
+        if (componentPool->GetVersion(index) > tick) {
+            func(GetEntity(componentPool->GetEntityId(index)), (*componentPool)[index]);
+        }
+    }
+}
+
+template <typename TComponent>
+Pool<TComponent>* Registry::GetPool() const {
     const auto componentId = Component<TComponent>::GetId();
-    const auto entityId = entity.GetId();
-    auto componentPool = std::static_pointer_cast<Pool<TComponent>>(componentPools[componentId]);
-    return componentPool->Get(entityId);
+    if constexpr (Component<TComponent>::STATIC_ID == -1) {
+        if (componentId >= static_cast<int>(componentPools.size())) {
+            return nullptr;
+        }
+    }
+    return static_cast<Pool<TComponent>*>(componentPools[componentId].get());
+}
+
+template <typename TComponent>
+Pool<TComponent>* Registry::AssurePool() {
+    const auto componentId = Component<TComponent>::GetId();
+
+    if (componentId >= static_cast<int>(componentPools.size())) {
+        componentPools.resize(componentId + 1);
+        componentArchetypes.resize(componentId + 1, -1);
+    }
+
+    if (!componentPools[componentId]) {
+        auto newComponentPool = std::make_unique<Pool<TComponent>>();
+        newComponentPool->SetTickSource(&currentTick);
+        componentPools[componentId] = std::move(newComponentPool);
+    }
+
+    return static_cast<Pool<TComponent>*>(componentPools[componentId].get());
+}
+
+template <typename TFunc>
+std::vector<Entity> Registry::Instantiate(const Prefab& prefab, int count, TFunc&& initializer) {
+    std::vector<Entity> entities = Instantiate(prefab, count);
+    for (int i = 0; i < static_cast<int>(entities.size()); i++) {
+        initializer(entities[i], i);
+    }
+    return entities;
+}
+
+template <typename TComponent>
+void Registry::InstantiateComponents(Registry& registry, const void* prototype, const std::vector<Entity>& entities) {
+    Pool<TComponent>* componentPool = registry.AssurePool<TComponent>();
+    componentPool->Reserve(componentPool->GetSize() + static_cast<int>(entities.size()));
+
+    const TComponent& component = *static_cast<const TComponent*>(prototype);
+    for (auto entity : entities) {
+        componentPool->Emplace(entity.GetId(), component);
+    }
+}
+
+template <typename TComponent, typename ...TArgs>
+void Prefab::AddComponent(TArgs&& ...args) {
+    const auto componentId = Component<TComponent>::GetId();
+
+    PrefabComponent prefabComponent;
+    prefabComponent.componentId = componentId;
+    prefabComponent.prototype = std::make_shared<const TComponent>(std::forward<TArgs>(args)...);
+    prefabComponent.instantiate = &Registry::InstantiateComponents<TComponent>;
+
+    for (auto& component : components) {
+        if (component.componentId == componentId) {
+            component = std::move(prefabComponent);
+            return;
+        }
+    }
+    components.push_back(std::move(prefabComponent));
+    signature.set(componentId);
+}
+
+template <typename ...TComponents>
+ComponentView<TComponents...> Registry::View() {
+    Signature signature;
+    ((ViewTerm<TComponents>::IS_REQUIRED ? signature.set(Component<typename ViewTerm<TComponents>::Type>::GetId()) : signature), ...);
+    return ComponentView<TComponents...>(this, FindArchetype(signature), GetPool<typename ViewTerm<TComponents>::Type>()...);
+}
+
+template <typename TComponent>
+void Registry::SetComponentOrder(std::function<bool(const TComponent&, const TComponent&)> order) {
+    AssurePool<TComponent>()->SetOrder(std::move(order));
+}
+
+template <typename ...TComponents>
+void Registry::AddArchetype() {
+    (AssurePool<TComponents>(), ...);
+
+    const std::vector<int> componentIds = {Component<TComponents>::GetId()...};
+    for (auto componentId : componentIds) {
+        if (componentArchetypes[componentId] != -1) {
+            Logger::Err("Component id = " + std::to_string(componentId) + " is already owned by another archetype");
+            return;
+        }
+    }
+
+    auto archetype = std::make_unique<Archetype>();
+    archetype->componentIds = componentIds;
+    for (auto componentId : componentIds) {
+        archetype->signature.set(componentId);
+        componentArchetypes[componentId] = static_cast<int>(archetypes.size());
+    }
+    archetypes.push_back(std::move(archetype));
+
+    // pack the entities that already have all the components
+    const IPool* pool = componentPools[componentIds[0]].get();
+    for (int entityId = 0; entityId < static_cast<int>(entityComponentSignatures.size()); entityId++) {
+        if (pool->Contains(entityId)) {
+            PackEntity(componentIds[0], entityId);
+        }
+    }
+
+    Logger::Log("Archetype added with " + std::to_string(componentIds.size()) + " component types");
+}
+
+template <typename TComponent>
+void CommandBuffer::AddBufferedComponent(Registry& registry, Entity entity, void* component) {
+    registry.EmplaceComponent<TComponent>(entity, std::move(*static_cast<TComponent*>(component)));
+}
+
+template <typename TComponent>
+void CommandBuffer::RemoveBufferedComponent(Registry& registry, Entity entity) {
+    registry.RemoveComponent<TComponent>(entity);
+}
+
+template <typename TComponent, typename TEntity, typename ...TArgs>
+void CommandBuffer::RecordAddComponent(TEntity entity, TArgs&& ...args) {
+    static_assert(alignof(TComponent) <= alignof(std::max_align_t), "over-aligned components cannot be buffered");
+
+    Record(CommandType::AddComponent, entity);
+    Command& command = commands.back();
+    command.component = new (Allocate(sizeof(TComponent), alignof(TComponent))) TComponent(std::forward<TArgs>(args)...);
+    command.addComponent = &AddBufferedComponent<TComponent>;
+    command.destroyComponent = &DestroyBufferedComponent<TComponent>;
+}
+
+template <typename TComponent, typename ...TArgs>
+void CommandBuffer::AddComponent(Entity entity, TArgs&& ...args) {
+    RecordAddComponent<TComponent>(entity, std::forward<TArgs>(args)...);
+}
+
+template <typename TComponent, typename ...TArgs>
+void CommandBuffer::AddComponent(DeferredEntity entity, TArgs&& ...args) {
+    RecordAddComponent<TComponent>(entity, std::forward<TArgs>(args)...);
+}
+
+template <typename TComponent>
+void CommandBuffer::RemoveComponent(Entity entity) {
+    Record(CommandType::RemoveComponent, entity);
+    commands.back().removeComponent = &RemoveBufferedComponent<TComponent>;
 }
 
 template <typename TComponent, typename ...TArgs>
@@ -358,6 +1753,12 @@ void Entity::RemoveComponent() {
     registry->RemoveComponent<TComponent>(*this);
 }
 
+template <typename ...TComponents>
+EntityFilter& EntityFilter::With() {
+    ((ViewTerm<TComponents>::IS_EXCLUDED ? excludedSignature.set(Component<typename ViewTerm<TComponents>::Type>::GetId()) : signature.set(Component<typename ViewTerm<TComponents>::Type>::GetId())), ...);
+    return *this;
+}
+
 template <typename TComponent>
 bool Entity::HasComponent() const {
     return registry->HasComponent<TComponent>(*this);
@@ -0,0 +1,96 @@
+#include "SystemScheduler.h"
+#include "../Logger/Logger.h"
+
+SystemScheduler::SystemScheduler(JobSystem& jobSystem): jobSystem(jobSystem) {
+    Logger::Log("SystemScheduler constructor called");
+}
+
+void SystemScheduler::Schedule(const System& system, std::function<void()> func) {
+    Task task;
+    task.system = &system;
+    task.func = std::move(func);
+
+    // depend on every earlier task that conflicts with this one
+    const int taskIndex = static_cast<int>(tasks.size());
+    for (int i = 0; i < taskIndex; i++) {
+        if (tasks[i].system->ConflictsWith(system)) {
+            tasks[i].dependents.push_back(taskIndex);
+            task.numDependencies++;
+        }
+    }
+
+    tasks.push_back(std::move(task));
+}
+
+void SystemScheduler::Run() {
+    numRemainingTasks = static_cast<int>(tasks.size());
+
+    for (int i = 0; i < static_cast<int>(tasks.size()); i++) {
+        if (tasks[i].numDependencies == 0) {
+            Release(i);
+        }
+    }
+
+    // the calling thread runs the exclusive tasks and helps with the jobs while it waits
+    std::unique_lock<std::mutex> lock(mutex);
+    while (numRemainingTasks > 0) {
+        if (!readyExclusiveTasks.empty()) {
+            int taskIndex = readyExclusiveTasks.front();
+            readyExclusiveTasks.pop_front();
+            lock.unlock();
+            tasks[taskIndex].func();
+            Complete(taskIndex);
+            lock.lock();
+            continue;
+        }
+
+        lock.unlock();
+        bool hasRunJob = jobSystem.RunPendingJob();
+        lock.lock();
+        if (!hasRunJob && readyExclusiveTasks.empty() && numRemainingTasks > 0) {
+            // the remaining tasks are running on worker threads
+            condition.wait(lock);
+        }
+    }
+
+    tasks.clear();
+}
+
+void SystemScheduler::Release(int taskIndex) {
+    if (tasks[taskIndex].system->IsExclusive()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        readyExclusiveTasks.push_back(taskIndex);
+        condition.notify_all();
+        return;
+    }
+
+    JobHandle handle;
+    jobSystem.Schedule(handle, [this, taskIndex]() {
+        tasks[taskIndex].func();
+        Complete(taskIndex);
+    });
+    
+    // wake up the calling thread so it can help with the new job
+    std::lock_guard<std::mutex> lock(mutex);
+    condition.notify_all();
+}
+
+void SystemScheduler::Complete(int taskIndex) {
+    std::vector<int> releasedTasks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto dependent : tasks[taskIndex].dependents) {
+            if (--tasks[dependent].numDependencies == 0) {
+                releasedTasks.push_back(dependent);
+            }
+        }
+    }
+
+    for (auto releasedTask : releasedTasks) {
+        Release(releasedTask);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    numRemainingTasks--;
+    condition.notify_all();
+}
@@ -0,0 +1,52 @@
+#ifndef SYSTEMSCHEDULER_H
+#define SYSTEMSCHEDULER_H
+
+#include "ECS.h"
+#include "../JobSystem/JobSystem.h"
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+// runs the systems of a frame as jobs of the job system
+// systems are scheduled in order, and a system only waits for the earlier systems it conflicts with
+// (a component written by one and read or written by the other, or an exclusive system)
+// exclusive systems always run on the calling thread
+// structural changes stay deferred until the next Registry::Update, which is called outside the scheduler
+class SystemScheduler {
+    private:
+        struct Task {
+            const System* system;
+            std::function<void()> func;
+            std::vector<int> dependents;
+            int numDependencies = 0;
+        };
+
+        JobSystem& jobSystem;
+        std::vector<Task> tasks;
+
+        // exclusive tasks whose dependencies have all completed
+        std::deque<int> readyExclusiveTasks;
+        int numRemainingTasks = 0;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        // hand a task whose dependencies have all completed to the job system or the calling thread
+        void Release(int taskIndex);
+        void Complete(int taskIndex);
+
+    public:
+        SystemScheduler(JobSystem& jobSystem);
+        ~SystemScheduler() = default;
+
+        // add the update of a system to the current frame
+        // example: scheduler->Schedule(movementSystem, [&]() { movementSystem.Update(registry, deltaTime); });
+        void Schedule(const System& system, std::function<void()> func);
+
+        // run all the scheduled tasks and wait until they are done
+        void Run();
+};
+
+#endif
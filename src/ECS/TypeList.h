@@ -0,0 +1,30 @@
+#ifndef TYPELIST_H
+#define TYPELIST_H
+
+// a list of types known at compile time, the position of a type in the list can be used as its id
+template <typename ...TTypes>
+struct TypeList {
+    static constexpr int SIZE = sizeof...(TTypes);
+};
+
+// position of a type in a type list, -1 if the type is not in the list
+template <typename T, typename TList>
+struct TypeIndex;
+
+template <typename T>
+struct TypeIndex<T, TypeList<>> {
+    static constexpr int value = -1;
+};
+
+template <typename T, typename ...TRest>
+struct TypeIndex<T, TypeList<T, TRest...>> {
+    static constexpr int value = 0;
+};
+
+template <typename T, typename TFirst, typename ...TRest>
+struct TypeIndex<T, TypeList<TFirst, TRest...>> {
+    static constexpr int restValue = TypeIndex<T, TypeList<TRest...>>::value;
+    static constexpr int value = restValue == -1 ? -1 : restValue + 1;
+};
+
+#endif
@@ -2,62 +2,307 @@
 #define EVENTBUS_H
 
 #include "../Logger/Logger.h"
+#include "../ECS/TypeList.h"
+#include "../Events/EventTypes.h"
 #include "Event.h"
-#include <map>
-#include <typeindex>
+#include <vector>
 #include <memory>
-#include <list>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include <functional>
 
+struct IEventType {
+    protected:
+        static inline int nextId = EventTypes::SIZE;
+};
 
+// used to assign a unique id to an event type
+// the types in EventTypes have their position in the list as a compile time id, the others get one at runtime
+template <typename TEvent>
+class EventType: public IEventType {
+    public:
+        static constexpr int STATIC_ID = TypeIndex<TEvent, EventTypes>::value;
 
+        static int GetId() {
+            if constexpr (STATIC_ID != -1) {
+                return STATIC_ID;
+            } else {
+                static auto id = nextId++;
+                return id;
+            }
+        }
+};
 
-class IEventCallback {
-    private:
-        virtual void Call(Event& e) = 0;
+// the filter of a subscription, events that can be filtered define the type of their filters as TEvent::Filter,
+// and a bool ApplyFilter(const Filter&) that tells if the event matches, it may reorder the event for the handler
+struct IEventFilter {
+    virtual ~IEventFilter() = default;
+};
 
-    public:
-        virtual ~IEventCallback() = default;
+template <typename TEvent>
+struct EventFilter: public IEventFilter {
+    typename TEvent::Filter filter;
 
-        void Execute(Event& e) {
-            Call(e);
-        }
+    // the matching events of a batch, kept to reuse its capacity
+    std::vector<TEvent> filteredEvents;
 
+    EventFilter(const typename TEvent::Filter& filter): filter(filter) {}
 };
 
-template <typename TOwner, typename TEvent>
-class EventCallback: public IEventCallback {
-    private:
+// a subscribed handler: the object it belongs to, its member function, and a trampoline
+// that casts both back to their types and calls the function, so a call is a single indirect call
+// the argument is an event, or the batch of queued events for the handlers of batches
+struct EventHandler {
+    class Owner;
+    typedef void (Owner::*AnyCallbackFunction)();
+    typedef void (*Trampoline)(const EventHandler& handler, void* argument);
+
+    void* ownerInstance;
+    alignas(AnyCallbackFunction) unsigned char callbackFunction[sizeof(AnyCallbackFunction)];
+    Trampoline trampoline;
+
+    // id of the subscription that added the handler
+    int subscriptionId;
+
+    // nullptr if the handler receives every event, owned by the event bus
+    IEventFilter* filter;
 
-        typedef void (TOwner::*CallbackFunction) (TEvent&);
-        
-        TOwner* ownerInstance;
+    // unsubscribed while an event was being dispatched, erased once the dispatch is over
+    bool isRemoved;
+
+    template <typename TOwner, typename TArgument>
+    static void Call(const EventHandler& handler, void* argument) {
+        typedef void (TOwner::*CallbackFunction)(TArgument&);
         CallbackFunction callbackFunction;
+        std::memcpy(&callbackFunction, handler.callbackFunction, sizeof(CallbackFunction));
+        (static_cast<TOwner*>(handler.ownerInstance)->*callbackFunction)(*static_cast<TArgument*>(argument));
+    }
 
-        virtual void Call(Event& e) override {
-            std::invoke(callbackFunction, ownerInstance, static_cast<TEvent&>(e));
+    // the handler is called with a copy of the event, if it matches the filter
+    template <typename TOwner, typename TEvent>
+    static void CallFiltered(const EventHandler& handler, void* argument) {
+        TEvent event = *static_cast<TEvent*>(argument);
+        if (event.ApplyFilter(static_cast<EventFilter<TEvent>*>(handler.filter)->filter)) {
+            Call<TOwner, TEvent>(handler, &event);
         }
+    }
 
-    public:
-        EventCallback(TOwner* ownerInstance, CallbackFunction callbackFunction) {
-            this->ownerInstance = ownerInstance;
-            this->callbackFunction = callbackFunction;
+    // the handler is called with the events of the batch that match the filter, if any does
+    template <typename TOwner, typename TEvent>
+    static void CallFilteredBatch(const EventHandler& handler, void* argument) {
+        auto& eventFilter = *static_cast<EventFilter<TEvent>*>(handler.filter);
+
+        // the handler may dispatch another batch of the same type, so the vector is taken out while it runs
+        std::vector<TEvent> events;
+        std::swap(events, eventFilter.filteredEvents);
+        for (const auto& event : *static_cast<const std::vector<TEvent>*>(argument)) {
+            events.push_back(event);
+            if (!events.back().ApplyFilter(eventFilter.filter)) {
+                events.pop_back();
+            }
         }
+        if (!events.empty()) {
+            Call<TOwner, const std::vector<TEvent>>(handler, &events);
+        }
+        events.clear();
+        std::swap(events, eventFilter.filteredEvents);
+    }
+
+    template <typename TOwner, typename TArgument>
+    static EventHandler Create(TOwner* ownerInstance, void (TOwner::*callbackFunction)(TArgument&), int subscriptionId) {
+        typedef void (TOwner::*CallbackFunction)(TArgument&);
+        static_assert(sizeof(CallbackFunction) <= sizeof(AnyCallbackFunction), "member function pointer too large");
+
+        EventHandler handler;
+        handler.ownerInstance = ownerInstance;
+        std::memcpy(handler.callbackFunction, &callbackFunction, sizeof(CallbackFunction));
+        handler.trampoline = &Call<TOwner, TArgument>;
+        handler.subscriptionId = subscriptionId;
+        handler.filter = nullptr;
+        handler.isRemoved = false;
+        return handler;
+    }
+};
+
+class EventBus;
+
+// the events of a type enqueued since the last dispatch
+// every thread appends to a buffer of its own without locking, the buffers are only read by Dispatch,
+// on the main thread at a sync point where no other thread enqueues
+class IEventQueue {
+    public:
+        virtual ~IEventQueue() = default;
+        virtual void Dispatch(EventBus& eventBus) = 0;
+};
+
+template <typename TEvent>
+class EventQueue: public IEventQueue {
+    private:
+        struct ThreadBuffer {
+            std::thread::id threadId;
+            std::vector<TEvent> events;
+        };
+
+        // registering the buffer of a new thread is the only locked operation
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+
+    public:
+        // the batch being dispatched, the buffers are moved into it so threads can enqueue while it is dispatched
+        // the vectors keep their capacity from frame to frame
+        std::vector<TEvent> dispatchedEvents;
 
-        virtual ~EventCallback() override = default;
+        // order of the events in a batch, so a replay dispatches them in the same order whatever thread enqueued them
+        // without it the batch follows the order the threads first enqueued in
+        std::function<bool(const TEvent&, const TEvent&)> order;
 
+        // the buffer of the calling thread, created the first time the thread enqueues
+        std::vector<TEvent>& GetThreadEvents() {
+            const std::thread::id threadId = std::this_thread::get_id();
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& buffer : threadBuffers) {
+                if (buffer->threadId == threadId) {
+                    return buffer->events;
+                }
+            }
+            threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+            threadBuffers.back()->threadId = threadId;
+            return threadBuffers.back()->events;
+        }
+
+        void Dispatch(EventBus& eventBus) override;
 };
 
-typedef std::list<std::unique_ptr<IEventCallback>> HandlerList;
+// returned by SubscribeToEvent, the handler stays subscribed until the subscription is passed to Unsubscribe
+struct Subscription {
+    int eventId = -1;
+    int id = 0;
+};
 
 class EventBus {
 
     private:
-        std::map<std::type_index, std::unique_ptr<HandlerList>> subscribers;
+        // vector index = event type id, handlers in subscription order
+        std::vector<std::vector<EventHandler>> subscribers;
+        std::vector<std::vector<EventHandler>> batchSubscribers;
+
+        // vector index = event type id, nullptr until an event of the type is enqueued
+        // guarded by queuesMutex when it grows, threads enqueue an event type for the first time concurrently
+        std::vector<std::unique_ptr<IEventQueue>> queues;
+        std::mutex queuesMutex;
+
+        // identifies the bus in the caches of the threads, ids are never reused
+        static inline std::atomic<int> nextBusId = 1;
+        const int busId = nextBusId++;
+
+        // the filters of the subscribed handlers
+        std::vector<std::unique_ptr<IEventFilter>> filters;
+
+        int nextSubscriptionId = 1;
 
+        // number of EmitEvent calls in progress, handlers may emit events themselves
+        int dispatchDepth = 0;
+        bool hasRemovedHandlers = false;
+
+        void EraseFilter(const IEventFilter* filter) {
+            if (filter == nullptr) {
+                return;
+            }
+            auto isFilter = [filter](const std::unique_ptr<IEventFilter>& other) {
+                return other.get() == filter;
+            };
+            filters.erase(std::remove_if(filters.begin(), filters.end(), isFilter), filters.end());
+        }
+
+        template <typename TEvent>
+        IEventFilter* AddFilter(const typename TEvent::Filter& filter) {
+            filters.push_back(std::make_unique<EventFilter<TEvent>>(filter));
+            return filters.back().get();
+        }
+
+        // erase the handlers unsubscribed during a dispatch
+        void EraseRemovedHandlers() {
+            auto isRemoved = [this](const EventHandler& handler) {
+                if (handler.isRemoved) {
+                    EraseFilter(handler.filter);
+                }
+                return handler.isRemoved;
+            };
+            for (auto& handlers : subscribers) {
+                handlers.erase(std::remove_if(handlers.begin(), handlers.end(), isRemoved), handlers.end());
+            }
+            for (auto& handlers : batchSubscribers) {
+                handlers.erase(std::remove_if(handlers.begin(), handlers.end(), isRemoved), handlers.end());
+            }
+            hasRemovedHandlers = false;
+        }
+
+        void AssureEventId(int eventId) {
+            if (eventId >= static_cast<int>(subscribers.size())) {
+                subscribers.resize(eventId + 1);
+                batchSubscribers.resize(eventId + 1);
+            }
+        }
+
+        template <typename TEvent>
+        EventQueue<TEvent>& AssureQueue() {
+            const int eventId = EventType<TEvent>::GetId();
+            std::lock_guard<std::mutex> lock(queuesMutex);
+            if (eventId >= static_cast<int>(queues.size())) {
+                queues.resize(eventId + 1);
+            }
+            if (!queues[eventId]) {
+                queues[eventId] = std::make_unique<EventQueue<TEvent>>();
+            }
+            return static_cast<EventQueue<TEvent>&>(*queues[eventId]);
+        }
+
+        // call the handlers of an event type that were subscribed when the call started
+        // handlers may subscribe and grow the vectors, so they are indexed again and each handler is copied out before it is called
+        void CallHandlers(const std::vector<std::vector<EventHandler>>& handlersPerEvent, int eventId, void* argument) {
+            const int numHandlers = static_cast<int>(handlersPerEvent[eventId].size());
+            dispatchDepth++;
+            for (int i = 0; i < numHandlers; i++) {
+                const EventHandler handler = handlersPerEvent[eventId][i];
+                if (!handler.isRemoved) {
+                    handler.trampoline(handler, argument);
+                }
+            }
+            dispatchDepth--;
+
+            if (dispatchDepth == 0 && hasRemovedHandlers) {
+                EraseRemovedHandlers();
+            }
+        }
+
+        template <typename TEvent> friend class EventQueue;
+
+        // hand a batch of queued events to the handlers of batches, and one by one to the other handlers
+        template <typename TEvent>
+        void DispatchBatch(std::vector<TEvent>& events) {
+            const int eventId = EventType<TEvent>::GetId();
+            if (eventId >= static_cast<int>(subscribers.size())) {
+                return;
+            }
+            if (!batchSubscribers[eventId].empty()) {
+                CallHandlers(batchSubscribers, eventId, &events);
+            }
+            if (!subscribers[eventId].empty()) {
+                for (auto& event : events) {
+                    CallHandlers(subscribers, eventId, &event);
+                }
+            }
+        }
 
     public:
         EventBus() {
+            AssureEventId(EventTypes::SIZE - 1);
+            queues.resize(EventTypes::SIZE);
             Logger::Log("EventBus constructor called");
         }
 
@@ -67,38 +312,171 @@ class EventBus {
 
         // clear subscribers list
         void Reset() {
-            subscribers.clear();
+            if (dispatchDepth > 0) {
+                for (auto& handlers : subscribers) {
+                    for (auto& handler : handlers) {
+                        handler.isRemoved = true;
+                    }
+                }
+                for (auto& handlers : batchSubscribers) {
+                    for (auto& handler : handlers) {
+                        handler.isRemoved = true;
+                    }
+                }
+                hasRemovedHandlers = true;
+                return;
+            }
+            for (auto& handlers : subscribers) {
+                handlers.clear();
+            }
+            for (auto& handlers : batchSubscribers) {
+                handlers.clear();
+            }
+            filters.clear();
         }
 
         // subscribe to an event type <T>
-        // a listenter subsribes to an event
+        // a listenter subsribes to an event, and keeps receiving it until it unsubscribes
+        // a handler subscribed while an event is dispatched is first called by the next emit
         // example: eventBus->SubscribeToEvent<CollisionEvent>(this, &Game::oncollision);
         template <typename TEvent, typename TOwner>
-        void SubscribeToEvent(TOwner* ownerInstance, void (TOwner::*callbackFunction)(TEvent&)) {
-            if (!subscribers[typeid(TEvent)].get()) {
-                subscribers[typeid(TEvent)] = std::make_unique<HandlerList>();
-            }
+        Subscription SubscribeToEvent(TOwner* ownerInstance, void (TOwner::*callbackFunction)(TEvent&)) {
+            const int eventId = EventType<TEvent>::GetId();
+            AssureEventId(eventId);
 
-            auto subscriber = std::make_unique<EventCallback<TOwner, TEvent>>(ownerInstance, callbackFunction);
-            // std::move is necessary because it is unique pointer
-            subscribers[typeid(TEvent)]->push_back(std::move(subscriber));
+            const int subscriptionId = nextSubscriptionId++;
+            subscribers[eventId].push_back(EventHandler::Create(ownerInstance, callbackFunction, subscriptionId));
+            return {eventId, subscriptionId};
+        }
+
+        // subscribe to the batches of queued events of type <T>, the handler receives all of them at once
+        // example: eventBus->SubscribeToEventBatch<CollisionEvent>(this, &DamageSystem::OnCollisions);
+        template <typename TEvent, typename TOwner>
+        Subscription SubscribeToEventBatch(TOwner* ownerInstance, void (TOwner::*callbackFunction)(const std::vector<TEvent>&)) {
+            const int eventId = EventType<TEvent>::GetId();
+            AssureEventId(eventId);
+
+            const int subscriptionId = nextSubscriptionId++;
+            batchSubscribers[eventId].push_back(EventHandler::Create(ownerInstance, callbackFunction, subscriptionId));
+            return {eventId, subscriptionId};
+        }
+
+        // subscribe with a filter, the handler is only called with the events that match it
+        // the events are checked before the handler is called, with the masks precomputed by the filter
+        // example: eventBus->SubscribeToEvent<CollisionEvent>(this, &DamageSystem::OnCollision, {EntityFilter().InGroup("projectiles"), EntityFilter().With<HealthComponent>()});
+        template <typename TEvent, typename TOwner>
+        Subscription SubscribeToEvent(TOwner* ownerInstance, void (TOwner::*callbackFunction)(TEvent&), const typename TEvent::Filter& filter) {
+            Subscription subscription = SubscribeToEvent(ownerInstance, callbackFunction);
+            EventHandler& handler = subscribers[subscription.eventId].back();
+            handler.filter = AddFilter<TEvent>(filter);
+            handler.trampoline = &EventHandler::CallFiltered<TOwner, TEvent>;
+            return subscription;
+        }
+
+        template <typename TEvent, typename TOwner>
+        Subscription SubscribeToEventBatch(TOwner* ownerInstance, void (TOwner::*callbackFunction)(const std::vector<TEvent>&), const typename TEvent::Filter& filter) {
+            Subscription subscription = SubscribeToEventBatch(ownerInstance, callbackFunction);
+            EventHandler& handler = batchSubscribers[subscription.eventId].back();
+            handler.filter = AddFilter<TEvent>(filter);
+            handler.trampoline = &EventHandler::CallFilteredBatch<TOwner, TEvent>;
+            return subscription;
+        }
+
+        // remove the handler of a subscription, it is safe to call from inside a handler
+        void Unsubscribe(Subscription subscription) {
+            if (subscription.eventId < 0 || subscription.eventId >= static_cast<int>(subscribers.size())) {
+                return;
+            }
+            auto isSubscription = [&subscription](const EventHandler& handler) {
+                return handler.subscriptionId == subscription.id;
+            };
+            for (auto handlers : {&subscribers[subscription.eventId], &batchSubscribers[subscription.eventId]}) {
+                auto handler = std::find_if(handlers->begin(), handlers->end(), isSubscription);
+                if (handler == handlers->end()) {
+                    continue;
+                }
+                if (dispatchDepth > 0) {
+                    handler->isRemoved = true;
+                    hasRemovedHandlers = true;
+                } else {
+                    EraseFilter(handler->filter);
+                    handlers->erase(handler);
+                }
+                return;
+            }
         }
 
         // emit an event of type <T>
         // as soon as something emits an event, go ahead and execute all the listener callback functions
+        // the event is constructed once and every handler receives the same object
         // example: eventBus->EmitEvent<CollisionEvent>(player, enemy)
         template <typename TEvent, typename ...TArgs>
         void EmitEvent(TArgs&& ...args) {
-            auto handlers = subscribers[typeid(TEvent)].get();
-            if (handlers) {
-                for (auto it = handlers->begin(); it != handlers->end(); it++) {
-                    auto handler = it->get();
-                    TEvent event(std::forward<TArgs>(args)...);
-                    handler->Execute(event);
+            const int eventId = EventType<TEvent>::GetId();
+            if (eventId >= static_cast<int>(subscribers.size()) || subscribers[eventId].empty()) {
+                return;
+            }
+
+            // the handlers appended during the dispatch are not called by this emit
+            TEvent event(std::forward<TArgs>(args)...);
+            CallHandlers(subscribers, eventId, &event);
+        }
+
+        // queue an event of type <T>, it is handed to the handlers by the next DispatchQueuedEvents
+        // any thread may enqueue, as long as it does not while the queued events are dispatched
+        // example: eventBus->Enqueue<CollisionEvent>(player, enemy)
+        template <typename TEvent, typename ...TArgs>
+        void Enqueue(TArgs&& ...args) {
+            // each thread caches the buffer it appends to, and only looks it up again when it enqueues on another bus
+            thread_local int cachedBusId = 0;
+            thread_local std::vector<TEvent>* cachedEvents = nullptr;
+            if (cachedBusId != busId) {
+                cachedEvents = &AssureQueue<TEvent>().GetThreadEvents();
+                cachedBusId = busId;
+            }
+            cachedEvents->emplace_back(std::forward<TArgs>(args)...);
+        }
+
+        // dispatch the batches of type <T> in the given order, for example to replay a game deterministically
+        // the order must not leave two different events tied, or their order depends on the threads again
+        template <typename TEvent>
+        void SetEventOrder(std::function<bool(const TEvent&, const TEvent&)> order) {
+            AssureQueue<TEvent>().order = std::move(order);
+        }
+
+        // hand every queued event to the handlers, the queues in event type id order
+        // it is the sync point of the threads that enqueue, none of them may enqueue during the call
+        // events enqueued by the handlers wait for the next call
+        void DispatchQueuedEvents() {
+            // handlers may enqueue events of a new type and grow the vector
+            for (size_t eventId = 0; eventId < queues.size(); eventId++) {
+                if (queues[eventId]) {
+                    queues[eventId]->Dispatch(*this);
                 }
             }
         }
 };
 
+template <typename TEvent>
+void EventQueue<TEvent>::Dispatch(EventBus& eventBus) {
+    for (auto& buffer : threadBuffers) {
+        if (dispatchedEvents.empty()) {
+            // usually a single thread enqueued, its buffer is swapped in without copying
+            std::swap(dispatchedEvents, buffer->events);
+        } else {
+            std::move(buffer->events.begin(), buffer->events.end(), std::back_inserter(dispatchedEvents));
+            buffer->events.clear();
+        }
+    }
+    if (dispatchedEvents.empty()) {
+        return;
+    }
+    if (order) {
+        std::sort(dispatchedEvents.begin(), dispatchedEvents.end(), order);
+    }
+    eventBus.DispatchBatch(dispatchedEvents);
+    dispatchedEvents.clear();
+}
+
 
-#endif
\ No newline at end of file
+#endif
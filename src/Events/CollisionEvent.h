@@ -10,6 +10,14 @@ class CollisionEvent: public Event{
         Entity b;
         CollisionEvent(Entity a, Entity b): a(a), b(b) {}
 
+        // handlers can subscribe with a filter on the colliding pair, in either order,
+        // the events they receive have the entity matching the first filter in a
+        typedef EntityPairFilter Filter;
+
+        bool ApplyFilter(const Filter& filter) {
+            return filter.Apply(a, b);
+        }
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifndef EVENTTYPES_H
+#define EVENTTYPES_H
+
+#include "../ECS/TypeList.h"
+
+class CollisionEvent;
+class KeyPressedEvent;
+
+// the event types of the game, the id of each one is its position in the list, known at compile time
+// an event type that is not listed still works, it gets an id after these the first time it is used
+typedef TypeList<
+    CollisionEvent,
+    KeyPressedEvent
+> EventTypes;
+
+#endif
@@ -37,6 +37,8 @@ Game::Game() {
     registry = std::make_unique<Registry>();
     assetStore = std::make_unique<AssetStore>();
     eventBus = std::make_unique<EventBus>();
+    jobSystem = std::make_unique<JobSystem>();
+    scheduler = std::make_unique<SystemScheduler>(*jobSystem);
     Logger::Log("Game constructor called");
 }
 
@@ -145,6 +147,31 @@ void Game::Setup() {
     registry->AddSystem<RenderGUISystem>();
     registry->AddSystem<ScriptSystem>();
 
+    // tiles and most level entities are iterated by the render system through transform and sprite
+    registry->AddArchetype<TransformComponent, SpriteComponent>();
+
+    // the render system draws by z index, then by the shared sprite data, keep the packed pools in that order
+    registry->SetComponentOrder<SpriteComponent>([](const SpriteComponent& a, const SpriteComponent& b) {
+        if (a.data->zIndex != b.data->zIndex) {
+            return a.data->zIndex < b.data->zIndex;
+        }
+        return a.data < b.data;
+    });
+
+    // collisions are found on worker threads, dispatch them in entity order so a run does not depend on the threads
+    eventBus->SetEventOrder<CollisionEvent>([](const CollisionEvent& a, const CollisionEvent& b) {
+        if (a.a.GetId() != b.a.GetId()) {
+            return a.a.GetId() < b.a.GetId();
+        }
+        return a.b.GetId() < b.b.GetId();
+    });
+
+    // subscriptions last across frames, the systems subscribe to their events once
+    registry->GetSystem<MovementSystem>().SubscribeToEvents(eventBus);
+    registry->GetSystem<DamageSystem>().SubscribeToEvents(eventBus);
+    registry->GetSystem<KeyboardControlSystem>().SubscribeToEvents(eventBus);
+    registry->GetSystem<ProjectileEmitSystem>().SubscribeToEvents(eventBus);
+
     // create bindings between C++ and lua
     registry->GetSystem<ScriptSystem>().CreateLuaBindings(lua);
 
@@ -165,6 +192,12 @@ void Game::Run() {
 void Game::Update() {
     // if too fast, wait until required time elapse
     int timeToWait = MILLISECS_PER_FRAME - (SDL_GetTicks() - millisecsPreviousFrame);
+
+    // spend some of the spare time putting the component pools back in order, keeping a margin for the delay
+    if (timeToWait > MILLISECS_TO_DEFRAGMENT) {
+        registry->Defragment(timeToWait - MILLISECS_TO_DEFRAGMENT);
+        timeToWait = MILLISECS_PER_FRAME - (SDL_GetTicks() - millisecsPreviousFrame);
+    }
     
     if (timeToWait > 0 && timeToWait <= MILLISECS_PER_FRAME) {
         SDL_Delay(timeToWait);
@@ -176,26 +209,35 @@ void Game::Update() {
     // store the current frame time
     millisecsPreviousFrame = SDL_GetTicks();
 
-    // reset all event handlers
-    eventBus->Reset();
-
-    // perform subscription of events for all systems
-    registry->GetSystem<MovementSystem>().SubscribeToEvents(eventBus);
-    registry->GetSystem<DamageSystem>().SubscribeToEvents(eventBus);
-    registry->GetSystem<KeyboardControlSystem>().SubscribeToEvents(eventBus);
-    registry->GetSystem<ProjectileEmitSystem>().SubscribeToEvents(eventBus);
-
     // update registry to process entities that are waiting to be created / deleted
     registry->Update();
 
-    // ask all the systems to update
-    registry->GetSystem<MovementSystem>().Update(deltaTime);
-    registry->GetSystem<AnimationSystem>().Update();
-    registry->GetSystem<CollisionSystem>().Update(eventBus);
-    registry->GetSystem<ProjectileEmitSystem>().Update(registry);
-    registry->GetSystem<CameraMovementSystem>().Update(camera);
-    registry->GetSystem<ProjectileLifecycleSystem>().Update();
-    registry->GetSystem<ScriptSystem>().Update(deltaTime, SDL_GetTicks());
+    // ask all the systems to update, the ones that do not conflict run in parallel
+    scheduler->Schedule(registry->GetSystem<MovementSystem>(), [&]() {
+        registry->GetSystem<MovementSystem>().Update(registry, jobSystem, deltaTime);
+    });
+    scheduler->Schedule(registry->GetSystem<AnimationSystem>(), [&]() {
+        registry->GetSystem<AnimationSystem>().Update(registry, jobSystem);
+    });
+    scheduler->Schedule(registry->GetSystem<ProjectileLifecycleSystem>(), [&]() {
+        registry->GetSystem<ProjectileLifecycleSystem>().Update(jobSystem);
+    });
+    scheduler->Schedule(registry->GetSystem<CameraMovementSystem>(), [&]() {
+        registry->GetSystem<CameraMovementSystem>().Update(camera);
+    });
+    scheduler->Schedule(registry->GetSystem<CollisionSystem>(), [&]() {
+        registry->GetSystem<CollisionSystem>().Update(registry, eventBus);
+    });
+    scheduler->Schedule(registry->GetSystem<ProjectileEmitSystem>(), [&]() {
+        registry->GetSystem<ProjectileEmitSystem>().Update(registry);
+    });
+    scheduler->Schedule(registry->GetSystem<ScriptSystem>(), [&]() {
+        registry->GetSystem<ScriptSystem>().Update(deltaTime, SDL_GetTicks());
+    });
+    scheduler->Run();
+
+    // the systems are done, hand the events they queued to the handlers
+    eventBus->DispatchQueuedEvents();
 }
 
 void Game::Render() {
@@ -204,7 +246,7 @@ void Game::Render() {
     SDL_RenderClear(renderer);
 
     // invoke all the systems that need to render
-    registry->GetSystem<RenderSystem>().Update(renderer, assetStore, camera);
+    registry->GetSystem<RenderSystem>().Update(registry, renderer, assetStore, camera);
     registry->GetSystem<RenderTextSystem>().Update(renderer, assetStore, camera);
     registry->GetSystem<RenderHealthBarSystem>().Update(renderer, assetStore, camera);
 
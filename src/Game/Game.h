@@ -4,12 +4,17 @@
 #include "../ECS/ECS.h"
 #include "../AssetStore/AssetStore.h"
 #include "../EventBus/EventBus.h"
+#include "../ECS/SystemScheduler.h"
+#include "../JobSystem/JobSystem.h"
 #include <SDL2/SDL.h>
 #include <sol/sol.hpp>
 
 const int FPS = 30;
 const int MILLISECS_PER_FRAME = 1000 / FPS;
 
+// spare time a frame needs before the registry is defragmented in it, and is left over after the defragmentation
+const int MILLISECS_TO_DEFRAGMENT = 8;
+
 class Game {
     private:
         bool isRunning;
@@ -23,6 +28,8 @@ class Game {
         std::unique_ptr<Registry> registry;
         std::unique_ptr<AssetStore> assetStore;
         std::unique_ptr<EventBus> eventBus;
+        std::unique_ptr<JobSystem> jobSystem;
+        std::unique_ptr<SystemScheduler> scheduler;
 
     public:
         Game();
@@ -76,20 +76,27 @@ void LevelLoader::LoadLevel(sol::state& lua, const std::unique_ptr<Registry>& re
     double mapScale = map["scale"];
     std::fstream mapFile;
     mapFile.open(mapFilePath);
-    for (int y = 0; y < mapNumRows; y++) {
-        for (int x = 0; x < mapNumCols; x++) {
-            char ch;
-            mapFile.get(ch);
-            int srcRectY = std::atoi(&ch) * tileSize;
-            mapFile.get(ch);
-            int srcRectX = std::atoi(&ch) * tileSize;
-            mapFile.ignore();
-
-            Entity tile = registry->CreateEntity();
-            tile.AddComponent<TransformComponent>(glm::vec2(x * (mapScale * tileSize), y * (mapScale * tileSize)), glm::vec2(mapScale, mapScale), 0.0);
-            tile.AddComponent<SpriteComponent>(mapTextureAssetId, tileSize, tileSize, 0, false, srcRectX, srcRectY);
-        }
-    }
+
+    // every tile has the same components, only the position and the source rectangle change
+    Prefab tilePrefab;
+    tilePrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(mapScale, mapScale), 0.0);
+    tilePrefab.AddComponent<SpriteComponent>(mapTextureAssetId, tileSize, tileSize, 0, false);
+    registry->Instantiate(tilePrefab, mapNumRows * mapNumCols, [&](Entity tile, int index) {
+        const int x = index % mapNumCols;
+        const int y = index / mapNumCols;
+
+        char ch;
+        mapFile.get(ch);
+        int srcRectY = std::atoi(&ch) * tileSize;
+        mapFile.get(ch);
+        int srcRectX = std::atoi(&ch) * tileSize;
+        mapFile.ignore();
+
+        tile.GetComponent<TransformComponent>().position = glm::vec2(x * (mapScale * tileSize), y * (mapScale * tileSize));
+        auto& sprite = tile.GetComponent<SpriteComponent>();
+        sprite.srcRect.x = srcRectX;
+        sprite.srcRect.y = srcRectY;
+    });
     mapFile.close();
     Game::mapWidth = mapNumCols * tileSize * mapScale;
     Game::mapHeight = mapNumRows * tileSize * mapScale;
@@ -112,13 +119,13 @@ void LevelLoader::LoadLevel(sol::state& lua, const std::unique_ptr<Registry>& re
         // Tag
         sol::optional<std::string> tag = entity["tag"];
         if (tag != sol::nullopt) {
-            newEntity.Tag(entity["tag"]);
+            newEntity.Tag(*tag);
         }
 
         // Group
         sol::optional<std::string> group = entity["group"];
         if (group != sol::nullopt) {
-            newEntity.Group(entity["group"]);
+            newEntity.Group(*group);
         }
 
         // Components
@@ -0,0 +1,128 @@
+#include "JobSystem.h"
+#include "../Logger/Logger.h"
+
+// index of the queue owned by the current thread, inside the job system that spawned it
+static thread_local const JobSystem* currentJobSystem = nullptr;
+static thread_local int currentQueueIndex = 0;
+
+JobSystem::JobSystem(int numWorkers): numQueuedJobs(0) {
+    numWorkers = std::max(numWorkers, 0);
+    for (int i = 0; i <= numWorkers; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (int i = 1; i <= numWorkers; i++) {
+        workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+    Logger::Log("JobSystem constructor called with " + std::to_string(workers.size()) + " worker threads");
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        isStopping = true;
+    }
+    sleepCondition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    Logger::Log("JobSystem destructor called");
+}
+
+int JobSystem::GetNumThreads() const {
+    return static_cast<int>(queues.size());
+}
+
+int JobSystem::GetQueueIndex() const {
+    return currentJobSystem == this ? currentQueueIndex : 0;
+}
+
+void JobSystem::Schedule(const JobHandle& handle, std::function<void()> func) {
+    handle.numPendingJobs->fetch_add(1, std::memory_order_relaxed);
+    Push(Job{std::move(func), handle.numPendingJobs});
+}
+
+void JobSystem::Push(Job job) {
+    auto& queue = *queues[GetQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    numQueuedJobs.fetch_add(1, std::memory_order_release);
+
+    // take the sleep lock so a worker cannot miss the notification between its check and its wait
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    sleepCondition.notify_one();
+}
+
+bool JobSystem::Pop(Job& job) {
+    if (numQueuedJobs.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+
+    // newest job of the own queue first, it is the most likely to be in cache
+    const int ownIndex = GetQueueIndex();
+    {
+        auto& queue = *queues[ownIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            numQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // otherwise steal the oldest job of another queue
+    const int numQueues = static_cast<int>(queues.size());
+    for (int offset = 1; offset < numQueues; offset++) {
+        auto& queue = *queues[(ownIndex + offset) % numQueues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            numQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::Execute(Job& job) {
+    job.func();
+    job.numPendingJobs->fetch_sub(1, std::memory_order_release);
+}
+
+bool JobSystem::RunPendingJob() {
+    Job job;
+    if (!Pop(job)) {
+        return false;
+    }
+    Execute(job);
+    return true;
+}
+
+void JobSystem::Wait(const JobHandle& handle) {
+    while (!handle.IsDone()) {
+        if (!RunPendingJob()) {
+            // the remaining jobs are running on other threads
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::WorkerLoop(int queueIndex) {
+    currentJobSystem = this;
+    currentQueueIndex = queueIndex;
+
+    while (true) {
+        if (RunPendingJob()) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this]() { return isStopping || numQueuedJobs.load(std::memory_order_acquire) > 0; });
+        if (isStopping) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// keeps track of a group of scheduled jobs
+class JobHandle {
+    private:
+        std::shared_ptr<std::atomic<int>> numPendingJobs;
+
+        friend class JobSystem;
+
+    public:
+        JobHandle(): numPendingJobs(std::make_shared<std::atomic<int>>(0)) {}
+
+        bool IsDone() const {
+            return numPendingJobs->load(std::memory_order_acquire) == 0;
+        }
+};
+
+// fixed set of worker threads, each one with its own deque of jobs
+// a thread pushes and pops jobs at the back of its own deque, and steals from the front of the
+// others when it runs out of work; threads that wait for a job handle run other jobs meanwhile
+class JobSystem {
+    private:
+        struct Job {
+            std::function<void()> func;
+            std::shared_ptr<std::atomic<int>> numPendingJobs;
+        };
+
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+        };
+
+        // queue 0 belongs to the threads that are not workers (the main thread)
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::thread> workers;
+
+        // sleeping workers are woken up when jobs are pushed
+        std::atomic<int> numQueuedJobs;
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+        bool isStopping = false;
+
+        int GetQueueIndex() const;
+        void Push(Job job);
+        bool Pop(Job& job);
+        void Execute(Job& job);
+        void WorkerLoop(int queueIndex);
+
+    public:
+        // numWorkers = number of threads besides the main one
+        JobSystem(int numWorkers = std::thread::hardware_concurrency() - 1);
+        ~JobSystem();
+
+        // number of threads that run jobs, including the main one
+        int GetNumThreads() const;
+
+        // add a job to the handle
+        void Schedule(const JobHandle& handle, std::function<void()> func);
+
+        // run one pending job on the calling thread, returns false if there was none
+        bool RunPendingJob();
+
+        // block until all the jobs of the handle are done, running other jobs meanwhile
+        void Wait(const JobHandle& handle);
+
+        // split [0, count) into chunks of at most grain elements, and run func(begin, end) for every chunk across threads
+        // returns when all the chunks are done
+        // example: jobSystem->ParallelFor(entities.size(), 1024, [&](int begin, int end) {...});
+        template <typename TFunc>
+        void ParallelFor(int count, int grain, const TFunc& func) {
+            if (count <= 0) {
+                return;
+            }
+            if (count <= grain || GetNumThreads() == 1) {
+                func(0, count);
+                return;
+            }
+
+            JobHandle handle;
+            for (int begin = grain; begin < count; begin += grain) {
+                const int end = std::min(begin + grain, count);
+                Schedule(handle, [&func, begin, end]() { func(begin, end); });
+            }
+
+            // the calling thread takes the first chunk
+            func(0, std::min(grain, count));
+            Wait(handle);
+        }
+};
+
+#endif
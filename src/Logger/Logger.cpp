@@ -3,8 +3,13 @@
 #include <string>
 #include <chrono>
 #include <ctime>
+#include <mutex>
 
 std::vector<LogEntry> Logger::messages;
+bool Logger::isEnabled = true;
+
+// systems running on worker threads can log at the same time, std::localtime is not thread safe either
+static std::mutex messagesMutex;
 
 std::string CurrentDateTimeToString() {
     std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
@@ -14,8 +19,13 @@ std::string CurrentDateTimeToString() {
 }
 
 void Logger::Log(const std::string& message) {
+    if (!isEnabled) {
+        return;
+    }
+
     LogEntry LogEntry;
     LogEntry.type = LOG_INFO;
+    std::lock_guard<std::mutex> lock(messagesMutex);
     LogEntry.message = "Log: [" + CurrentDateTimeToString() + "]: " + message;
     std::cout << "\x1B[32m" << LogEntry.message << "\033[0m" << std::endl;
 
@@ -25,6 +35,7 @@ void Logger::Log(const std::string& message) {
 void Logger::Err(const std::string& message) {
     LogEntry LogEntry;
     LogEntry.type = LOG_ERROR;
+    std::lock_guard<std::mutex> lock(messagesMutex);
     LogEntry.message = "Err: [" + CurrentDateTimeToString() + "]: " + message;
     std::cout << "\x1B[91m" << LogEntry.message << "\033[0m" << std::endl;
 
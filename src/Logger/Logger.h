@@ -18,6 +18,10 @@ struct LogEntry {
 class Logger {
     public:
         static std::vector<LogEntry> messages;
+
+        // info messages are dropped while this is false, like in the benchmarks and tests, errors are always logged
+        // the hot paths check it before building their message
+        static bool isEnabled;
         static void Log(const std::string& message);
         static void Err(const std::string& message);
 };
@@ -2,6 +2,7 @@
 #define ANIMATIONSYSTEM_H
 
 #include "../ECS/ECS.h"
+#include "../JobSystem/JobSystem.h"
 #include "../Components/AnimationComponent.h"
 #include "../Components/SpriteComponent.h"
 
@@ -12,15 +13,16 @@ class AnimationSystem: public System {
             RequireComponent<SpriteComponent>();
         }
 
-        void Update() {
-            for (auto entity : GetSystemEntities()) {
-                auto& animation = entity.GetComponent<AnimationComponent>();
-                auto& sprite = entity.GetComponent<SpriteComponent>();
+        void Update(const std::unique_ptr<Registry>& registry, const std::unique_ptr<JobSystem>& jobSystem) {
+            auto view = registry->View<AnimationComponent, SpriteComponent>();
+            const Uint32 ticks = SDL_GetTicks();
+            jobSystem->ParallelFor(view.SizeHint(), 1024, [&view, ticks](int begin, int end) {
+                view.EachInRange(begin, end, [ticks](Entity, AnimationComponent& animation, SpriteComponent& sprite) {
+                    animation.currentFrame = ((ticks - animation.startTime) * animation.frameSpeedRate / 1000) % animation.numFrames;
 
-                animation.currentFrame = ((SDL_GetTicks() - animation.startTime) * animation.frameSpeedRate / 1000) % animation.numFrames;
-
-                sprite.srcRect.x = animation.currentFrame * sprite.width;
-            }
+                    sprite.srcRect.x = animation.currentFrame * sprite.data->width;
+                });
+            });
         }
 };
 
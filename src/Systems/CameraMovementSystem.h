@@ -9,13 +9,13 @@
 class CameraMovementSystem: public System {
     public:
         CameraMovementSystem() {
-            RequireComponent<CameraFollowComponent>();
-            RequireComponent<TransformComponent>();
+            RequireComponent<CameraFollowComponent>(ComponentAccess::Read);
+            RequireComponent<TransformComponent>(ComponentAccess::Read);
         }
 
         void Update(SDL_Rect& camera) {
             for (auto entity: GetSystemEntities()) {
-                auto transform = entity.GetComponent<TransformComponent>();
+                auto transform = entity.GetComponent<const TransformComponent>();
 
                 if (transform.position.x < Game::mapWidth) {
                     camera.x = transform.position.x - Game::windowWidth / 2;
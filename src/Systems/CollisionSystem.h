@@ -10,45 +10,47 @@
 class CollisionSystem: public System {
     public:
         CollisionSystem() {
-            RequireComponent<TransformComponent>();
-            RequireComponent<BoxColliderComponent>();
+            RequireComponent<TransformComponent>(ComponentAccess::Read);
+            RequireComponent<BoxColliderComponent>(ComponentAccess::Read);
         }
 
-        void Update(std::unique_ptr<EventBus>& eventBus) {
-            auto entities = GetSystemEntities();
+        void Update(const std::unique_ptr<Registry>& registry, std::unique_ptr<EventBus>& eventBus) {
+            // gather the world space boxes once, so the pair loop below only reads contiguous memory
+            struct CollisionBox {
+                Entity entity;
+                double x;
+                double y;
+                double width;
+                double height;
+            };
+            auto view = registry->View<const TransformComponent, const BoxColliderComponent>();
+            std::vector<CollisionBox> boxes;
+            boxes.reserve(view.SizeHint());
+            view.Each([&boxes](Entity entity, const TransformComponent& transform, const BoxColliderComponent& collider) {
+                boxes.push_back({
+                    entity,
+                    transform.position.x + collider.offset.x,
+                    transform.position.y + collider.offset.y,
+                    static_cast<double>(collider.width),
+                    static_cast<double>(collider.height)
+                });
+            });
 
-            for (auto i = entities.begin(); i != entities.end(); i++) {
-                Entity a = *i;
-                auto aTransform = a.GetComponent<TransformComponent>();
-                auto aCollider = a.GetComponent<BoxColliderComponent>();
+            for (auto i = boxes.begin(); i != boxes.end(); i++) {
+                const CollisionBox& a = *i;
 
-
-                for (auto j = i; j != entities.end(); j++) {
-                    Entity b = *j;
-
-                    if (a == b) {
-                        continue;
-                    }
-
-                    auto bTransform = b.GetComponent<TransformComponent>();
-                    auto bCollider = b.GetComponent<BoxColliderComponent>();
+                for (auto j = i + 1; j != boxes.end(); j++) {
+                    const CollisionBox& b = *j;
 
                     // AABB collision check
-                    bool collisionHappend = CheckAABBCollision(
-                        aTransform.position.x + aCollider.offset.x,
-                        aTransform.position.y + aCollider.offset.y,
-                        aCollider.width,
-                        aCollider.height,
-                        bTransform.position.x + bCollider.offset.x,
-                        bTransform.position.y + bCollider.offset.y,
-                        bCollider.width,
-                        bCollider.height
-                    );
+                    bool collisionHappend = CheckAABBCollision(a.x, a.y, a.width, a.height, b.x, b.y, b.width, b.height);
 
                     if (collisionHappend) {
-                        Logger::Log("Entity " + std::to_string(a.GetId()) + " is colliding with " + std::to_string(b.GetId())); 
+                        Logger::Log("Entity " + std::to_string(a.entity.GetId()) + " is colliding with " + std::to_string(b.entity.GetId())); 
 
-                        eventBus->EmitEvent<CollisionEvent>(a, b);
+                        // the handlers get the whole batch once the systems are done updating,
+                        // enqueueing is safe from the worker thread the system runs on
+                        eventBus->Enqueue<CollisionEvent>(a.entity, b.entity);
 
                     }
 
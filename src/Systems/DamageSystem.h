@@ -8,41 +8,53 @@
 #include "../EventBus/EventBus.h"
 #include "../Events/CollisionEvent.h"
 #include "../Logger/Logger.h"
+#include <vector>
 
 
 class DamageSystem: public System {
+    private:
+        int playerTagId;
+        int enemiesGroupId;
+
     public:
         DamageSystem() {
             RequireComponent<BoxColliderComponent>();
+
+            playerTagId = Registry::GetTagId("player");
+            enemiesGroupId = Registry::GetGroupId("enemies");
         }
 
         void SubscribeToEvents(std::unique_ptr<EventBus>& eventBus) {
-            eventBus->SubscribeToEvent<CollisionEvent>(this, &DamageSystem::OnCollision);
+            // only a projectile hitting the player or an enemy that has health does damage
+            EntityPairFilter filter;
+            filter.first.InGroup("projectiles");
+            filter.second.With<HealthComponent>().WithTag("player").InGroup("enemies");
+            eventBus->SubscribeToEventBatch<CollisionEvent>(this, &DamageSystem::OnCollisions, filter);
         }
 
-        void OnCollision(CollisionEvent& event) {
-            Entity a = event.a;
-            Entity b = event.b;
-            Logger::Log("The damage system received an event collision between entities " + std::to_string(event.a.GetId()) + " and " + std::to_string(event.b.GetId()));
+        void OnCollisions(const std::vector<CollisionEvent>& events) {
+            Logger::Log("The damage system received " + std::to_string(events.size()) + " collision events");
 
-            if (a.BelongsToGroup("projectiles") && b.HasTag("player")) {
-                OnProjectileHitsPlayer(a, b);
-            }
+            // the filter puts the projectile first
+            for (const auto& event : events) {
+                Entity projectile = event.a;
+                Entity other = event.b;
 
-            if (b.BelongsToGroup("projectiles") && a.HasTag("player")) {
-                OnProjectileHitsPlayer(b, a);
-            }
-            if (a.BelongsToGroup("projectiles") && b.BelongsToGroup("enemies")) {
-                OnProjectileHitsEnemy(a, b);
+                // an entity killed earlier in the frame, like a projectile that already hit something, does no more damage
+                if (!projectile.IsAlive() || !other.IsAlive()) {
+                    continue;
+                }
 
-            }
-            if (b.BelongsToGroup("projectiles") && a.BelongsToGroup("enemies")) {
-                OnProjectileHitsEnemy(b, a);
+                if (other.HasTag(playerTagId)) {
+                    OnProjectileHitsPlayer(projectile, other);
+                } else if (other.BelongsToGroup(enemiesGroupId)) {
+                    OnProjectileHitsEnemy(projectile, other);
+                }
             }
         }
 
         void OnProjectileHitsPlayer(Entity projectile, Entity player) {
-            auto projectileComponent = projectile.GetComponent<ProjectileComponent>();
+            auto projectileComponent = projectile.GetComponent<const ProjectileComponent>();
 
             if (!projectileComponent.isFriendly) {
                 auto& health = player.GetComponent<HealthComponent>();
@@ -57,7 +69,7 @@ class DamageSystem: public System {
         }
 
         void OnProjectileHitsEnemy(Entity projectile, Entity enemy) {
-            auto projectileComponent = projectile.GetComponent<ProjectileComponent>();
+            auto projectileComponent = projectile.GetComponent<const ProjectileComponent>();
 
             if (projectileComponent.isFriendly) {
                 auto& health = enemy.GetComponent<HealthComponent>();
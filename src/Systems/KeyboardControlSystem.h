@@ -25,26 +25,26 @@ class KeyboardControlSystem: public System {
             // change sprite and velocity of entity
 
             for (auto entity : GetSystemEntities()) {
-                const auto keyboardControl = entity.GetComponent<KeyboardControlledComponent>();
+                const auto keyboardControl = entity.GetComponent<const KeyboardControlledComponent>();
                 auto& sprite = entity.GetComponent<SpriteComponent>();
                 auto& rigidBody = entity.GetComponent<RigidBodyComponent>();
 
                 switch (event.symbol) {
                     case SDLK_UP:
                         rigidBody.velocity = keyboardControl.upVelocity;
-                        sprite.srcRect.y = sprite.height * 0;
+                        sprite.srcRect.y = sprite.data->height * 0;
                         break;
                     case SDLK_RIGHT:
                         rigidBody.velocity = keyboardControl.rightVelocity;
-                        sprite.srcRect.y = sprite.height * 1;
+                        sprite.srcRect.y = sprite.data->height * 1;
                         break;
                     case SDLK_DOWN:
                         rigidBody.velocity = keyboardControl.downVelocity;
-                        sprite.srcRect.y = sprite.height * 2;
+                        sprite.srcRect.y = sprite.data->height * 2;
                         break;
                     case SDLK_LEFT:
                         rigidBody.velocity = keyboardControl.leftVelocity;
-                        sprite.srcRect.y = sprite.height * 3;
+                        sprite.srcRect.y = sprite.data->height * 3;
                         break;
                 }
             }
@@ -3,79 +3,74 @@
 
 #include "../ECS/ECS.h"
 #include "../EventBus/EventBus.h"
+#include "../JobSystem/JobSystem.h"
 #include "../Events/CollisionEvent.h"
 #include "../Components/TransformComponent.h"
 #include "../Components/RigidBodyComponent.h"
 #include "../Components/SpriteComponent.h"
+#include "../Components/KeyboardControlledComponent.h"
+#include <vector>
 
 class MovementSystem: public System {
     public:
         MovementSystem() {
             RequireComponent<TransformComponent>();
-            RequireComponent<RigidBodyComponent>();
-
+            RequireComponent<RigidBodyComponent>(ComponentAccess::Read);
+            RequireComponent<Optional<KeyboardControlledComponent>>(ComponentAccess::Read);
         }
 
         void SubscribeToEvents(std::unique_ptr<EventBus>& eventBus) {
-            eventBus->SubscribeToEvent<CollisionEvent>(this, &MovementSystem::OnCollision);
+            // only enemies hitting obstacles bounce
+            EntityPairFilter filter;
+            filter.first.InGroup("enemies");
+            filter.second.InGroup("obstacles");
+            eventBus->SubscribeToEventBatch<CollisionEvent>(this, &MovementSystem::OnCollisions, filter);
         }
 
-        void Update(double deltaTime) {
-            // loop all entities that the system is interested in
-            for (auto entity : GetSystemEntities()) {
-                // update entity position based on its velocity
-                auto& transform = entity.GetComponent<TransformComponent>();
-                const auto rigidBody = entity.GetComponent<RigidBodyComponent>();
-
+        void Update(const std::unique_ptr<Registry>& registry, const std::unique_ptr<JobSystem>& jobSystem, double deltaTime) {
+            // loop all entities that have a transform and a rigid body, split in chunks across threads
+            // the entities that are not keyboard controlled are killed when they leave the map
+            auto view = registry->View<TransformComponent, const RigidBodyComponent, Without<KeyboardControlledComponent>>();
+            jobSystem->ParallelFor(view.SizeHint(), 1024, [&view, deltaTime](int begin, int end) {
+                view.EachInRange(begin, end, [deltaTime](Entity entity, TransformComponent& transform, const RigidBodyComponent& rigidBody) {
+                    // update entity position based on its velocity
+                    transform.position.x += rigidBody.velocity.x * deltaTime;
+                    transform.position.y += rigidBody.velocity.y * deltaTime;
+
+                    int margin = 100;
+                    bool isEntityOutsideMap = (
+                        transform.position.x < -margin ||
+                        transform.position.x > Game::mapWidth + margin || 
+                        transform.position.y < -margin ||
+                        transform.position.y > Game::mapHeight + margin
+                    );
+
+                    if (isEntityOutsideMap) {
+                        entity.Kill();
+                    }
+                });
+            });
+
+            // the keyboard controlled entities, like the player, are kept inside the map instead
+            registry->View<TransformComponent, const RigidBodyComponent, const KeyboardControlledComponent>().Each([deltaTime](Entity, TransformComponent& transform, const RigidBodyComponent& rigidBody, const KeyboardControlledComponent&) {
                 transform.position.x += rigidBody.velocity.x * deltaTime;
                 transform.position.y += rigidBody.velocity.y * deltaTime;
 
-                if (entity.HasTag("player")) {
-                    int paddingLeft = 10;
-                    int paddingTop = 10;
-                    int paddingRight = 50;
-                    int paddingBottom = 50;
-                    transform.position.x = transform.position.x < paddingLeft ? paddingLeft : transform.position.x;
-                    transform.position.x = transform.position.x > Game::mapWidth - paddingRight ? Game::mapWidth - paddingRight : transform.position.x;
-                    transform.position.y = transform.position.y < paddingTop ? paddingTop : transform.position.y;
-                    transform.position.y = transform.position.y > Game::mapHeight - paddingBottom ? Game::mapHeight - paddingBottom : transform.position.y;
-                }
-
-                int margin = 100;
-                bool isEntityOutsideMap = (
-                    transform.position.x < -margin ||
-                    transform.position.x > Game::mapWidth + margin || 
-                    transform.position.y < -margin ||
-                    transform.position.y > Game::mapHeight + margin
-                );
-
-                if (isEntityOutsideMap && !entity.HasTag("player")) {
-                    entity.Kill();
-                }
-
-                // Logger::Log(
-                //     "Entity id = " +
-                //     std::to_string(entity.GetId()) +
-                //     " position is now (" +
-                //     std::to_string(transform.position.x) +
-                //     ", " +
-                //     std::to_string(transform.position.y) +
-                //     ")"
-                // );
-            }
-
+                int paddingLeft = 10;
+                int paddingTop = 10;
+                int paddingRight = 50;
+                int paddingBottom = 50;
+                transform.position.x = transform.position.x < paddingLeft ? paddingLeft : transform.position.x;
+                transform.position.x = transform.position.x > Game::mapWidth - paddingRight ? Game::mapWidth - paddingRight : transform.position.x;
+                transform.position.y = transform.position.y < paddingTop ? paddingTop : transform.position.y;
+                transform.position.y = transform.position.y > Game::mapHeight - paddingBottom ? Game::mapHeight - paddingBottom : transform.position.y;
+            });
         }
 
-        void OnCollision(CollisionEvent& event) {
-            Entity a = event.a;
-            Entity b = event.b;
-
-            if (a.BelongsToGroup("obstacles") && b.BelongsToGroup("enemies")) {
-                OnEnemyHitsObstacle(b, a);
-            }
-
-            if (b.BelongsToGroup("obstacles") && a.BelongsToGroup("enemies")) {
-                OnEnemyHitsObstacle(a, b);
+        void OnCollisions(const std::vector<CollisionEvent>& events) {
+            // the filter puts the enemy first
+            for (const auto& event : events) {
+                OnEnemyHitsObstacle(event.a, event.b);
             }
         }
 
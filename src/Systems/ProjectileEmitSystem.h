@@ -10,14 +10,28 @@
 #include "../Components/BoxColliderComponent.h"
 #include "../Components/ProjectileEmitterComponent.h"
 #include "../Components/ProjectileComponent.h"
+#include "../Components/CameraFollowComponent.h"
 #include <SDL2/SDL.h>
 #include <memory>
 
 class ProjectileEmitSystem: public System {
+    private:
+        // the components every projectile starts with, the sprite and the group are interned once instead of for every projectile
+        // the instances are created in one batch when the command buffer is played back
+        Prefab projectilePrefab;
+
     public:
         ProjectileEmitSystem() {
             RequireComponent<ProjectileEmitterComponent>();
-            RequireComponent<TransformComponent>();
+            RequireComponent<TransformComponent>(ComponentAccess::Read);
+            RequireComponent<Optional<SpriteComponent>>(ComponentAccess::Read);
+
+            projectilePrefab.AddComponent<TransformComponent>(glm::vec2(0.0, 0.0), glm::vec2(1.0, 1.0), 0.0);
+            projectilePrefab.AddComponent<RigidBodyComponent>();
+            projectilePrefab.AddComponent<SpriteComponent>("bullet-texture", 4, 4, 10);
+            projectilePrefab.AddComponent<BoxColliderComponent>(4, 4);
+            projectilePrefab.AddComponent<ProjectileComponent>();
+            projectilePrefab.Group("projectiles");
         }
 
         void SubscribeToEvents(std::unique_ptr<EventBus>& eventBus) {
@@ -25,87 +39,79 @@ class ProjectileEmitSystem: public System {
         }
 
         void OnKeyPressed(KeyPressedEvent& event) {
-            if (event.symbol == SDLK_SPACE) {
-                for (auto entity: GetSystemEntities()) {
-                if (entity.HasComponent<CameraFollowComponent>()) {
-                    const auto projectileEmitter = entity.GetComponent<ProjectileEmitterComponent>();
-                    const auto transform = entity.GetComponent<TransformComponent>();
-                    const auto rigidBody = entity.GetComponent<RigidBodyComponent>();
-
-                    glm::vec2 projectilePosition = transform.position;
-                    if (entity.HasComponent<SpriteComponent>()) {
-                        const auto sprite = entity.GetComponent<SpriteComponent>();
-                        projectilePosition.x += (transform.scale.x * sprite.width / 2);
-                        projectilePosition.y += (transform.scale.y * sprite.height / 2);
-                    }
-
-                    // change velocity of projectile
-                    glm::vec2 projectileVelocity = projectileEmitter.projectileVelocity;
-                    int directionX = 0;
-                    int directionY = 0;
-                    if (rigidBody.velocity.x > 0) {
-                        directionX = 1;
-                    }
-                    if (rigidBody.velocity.x < 0) {
-                        directionX = -1;
-                    }
-                    if (rigidBody.velocity.y > 0) {
-                        directionY = 1;
-                    }
-                    if (rigidBody.velocity.y < 0) {
-                        directionY = -1;
-                    }
-                    projectileVelocity.x = projectileEmitter.projectileVelocity.x * directionX;
-                    projectileVelocity.y = projectileEmitter.projectileVelocity.y * directionY;
+            if (event.symbol != SDLK_SPACE) {
+                return;
+            }
 
+            // only the emitters followed by the camera, like the player, shoot on key press
+            CommandBuffer commandBuffer;
+            auto view = Entity::registry->View<const ProjectileEmitterComponent, const TransformComponent, const RigidBodyComponent, const CameraFollowComponent, Optional<const SpriteComponent>>();
+            view.Each([this, &commandBuffer](Entity, const ProjectileEmitterComponent& projectileEmitter, const TransformComponent& transform, const RigidBodyComponent& rigidBody, const CameraFollowComponent&, const SpriteComponent* sprite) {
+                glm::vec2 projectilePosition = GetProjectilePosition(transform, sprite);
 
-                    // Add a new projectile entity to the registry
-                    Entity projectile = entity.registry->CreateEntity();
-                    projectile.Group("projectiles");
-                    projectile.AddComponent<TransformComponent>(projectilePosition, glm::vec2(1.0, 1.0), 0.0);
-                    projectile.AddComponent<RigidBodyComponent>(projectileVelocity);
-                    projectile.AddComponent<SpriteComponent>("bullet-texture", 4, 4, 10);
-                    projectile.AddComponent<BoxColliderComponent>(4, 4);
-                    projectile.AddComponent<ProjectileComponent>(projectileEmitter.isFriendly, projectileEmitter.hitPercentDamage, projectileEmitter.projectileDuration);
+                // change velocity of projectile
+                glm::vec2 projectileVelocity = projectileEmitter.projectileVelocity;
+                int directionX = 0;
+                int directionY = 0;
+                if (rigidBody.velocity.x > 0) {
+                    directionX = 1;
                 }
-            }
-
+                if (rigidBody.velocity.x < 0) {
+                    directionX = -1;
+                }
+                if (rigidBody.velocity.y > 0) {
+                    directionY = 1;
+                }
+                if (rigidBody.velocity.y < 0) {
+                    directionY = -1;
+                }
+                projectileVelocity.x = projectileEmitter.projectileVelocity.x * directionX;
+                projectileVelocity.y = projectileEmitter.projectileVelocity.y * directionY;
 
-            }
-            
+                // Add a new projectile entity to the registry
+                SpawnProjectile(commandBuffer, projectilePosition, projectileVelocity, projectileEmitter);
+            });
+            Entity::registry->Submit(std::move(commandBuffer));
         }
 
         void Update(std::unique_ptr<Registry>& registry) {
-            for (auto entity: GetSystemEntities()) {
-                auto& projectileEmitter = entity.GetComponent<ProjectileEmitterComponent>();
-                const auto transform = entity.GetComponent<TransformComponent>();
+            // projectiles are recorded in a command buffer, so the system can run on a worker thread
+            CommandBuffer commandBuffer;
 
+            auto view = registry->View<ProjectileEmitterComponent, const TransformComponent, Optional<const SpriteComponent>>();
+            view.Each([this, &commandBuffer](Entity, ProjectileEmitterComponent& projectileEmitter, const TransformComponent& transform, const SpriteComponent* sprite) {
                 if (projectileEmitter.repeatFrequency == 0) {
-                    continue;
+                    return;
                 }
 
                 // Check if its time to re-emit a new projectile
                 if (SDL_GetTicks() - projectileEmitter.lastEmissionTime > projectileEmitter.repeatFrequency) {
-                    glm::vec2 projectilePosition = transform.position;
-                    if (entity.HasComponent<SpriteComponent>()) {
-                        const auto sprite = entity.GetComponent<SpriteComponent>();
-                        projectilePosition.x += (transform.scale.x * sprite.width / 2);
-                        projectilePosition.y += (transform.scale.y * sprite.height / 2);
-                    }
-
                     // Add a new projectile entity to the registry
-                    Entity projectile = registry->CreateEntity();
-                    projectile.Group("projectiles");
-                    projectile.AddComponent<TransformComponent>(projectilePosition, glm::vec2(1.0, 1.0), 0.0);
-                    projectile.AddComponent<RigidBodyComponent>(projectileEmitter.projectileVelocity);
-                    projectile.AddComponent<SpriteComponent>("bullet-texture", 4, 4, 10);
-                    projectile.AddComponent<BoxColliderComponent>(4, 4);
-                    projectile.AddComponent<ProjectileComponent>(projectileEmitter.isFriendly, projectileEmitter.hitPercentDamage, projectileEmitter.projectileDuration);
+                    SpawnProjectile(commandBuffer, GetProjectilePosition(transform, sprite), projectileEmitter.projectileVelocity, projectileEmitter);
                 
                     // Update the projectile emitter component last emission to the current milliseconds
                     projectileEmitter.lastEmissionTime = SDL_GetTicks();
                 }
+            });
+
+            registry->Submit(std::move(commandBuffer));
+        }
+
+        // projectiles leave from the center of the sprite of the emitter, or from its position if it has no sprite
+        glm::vec2 GetProjectilePosition(const TransformComponent& transform, const SpriteComponent* sprite) const {
+            glm::vec2 projectilePosition = transform.position;
+            if (sprite) {
+                projectilePosition.x += (transform.scale.x * sprite->data->width / 2);
+                projectilePosition.y += (transform.scale.y * sprite->data->height / 2);
             }
+            return projectilePosition;
+        }
+
+        void SpawnProjectile(CommandBuffer& commandBuffer, glm::vec2 position, glm::vec2 velocity, const ProjectileEmitterComponent& projectileEmitter) {
+            DeferredEntity projectile = commandBuffer.Instantiate(projectilePrefab);
+            commandBuffer.AddComponent<TransformComponent>(projectile, position, glm::vec2(1.0, 1.0), 0.0);
+            commandBuffer.AddComponent<RigidBodyComponent>(projectile, velocity);
+            commandBuffer.AddComponent<ProjectileComponent>(projectile, projectileEmitter.isFriendly, projectileEmitter.hitPercentDamage, projectileEmitter.projectileDuration);
         }
 };
 
@@ -3,22 +3,28 @@
 
 #include "../ECS/ECS.h"
 #include "../Components/ProjectileComponent.h"
+#include "../JobSystem/JobSystem.h"
+#include <memory>
 
 class ProjectileLifecycleSystem: public System {
     public:
         ProjectileLifecycleSystem() {
-            RequireComponent<ProjectileComponent>();
+            RequireComponent<ProjectileComponent>(ComponentAccess::Read);
         }
 
-        void Update() {
-            for (auto entity : GetSystemEntities()) {
-                auto projectile = entity.GetComponent<ProjectileComponent>();
+        void Update(const std::unique_ptr<JobSystem>& jobSystem) {
+            const auto& entities = GetSystemEntities();
+            const Uint32 ticks = SDL_GetTicks();
+            jobSystem->ParallelFor(static_cast<int>(entities.size()), 1024, [&entities, ticks](int begin, int end) {
+                for (int i = begin; i < end; i++) {
+                    Entity entity = entities[i];
+                    const auto& projectile = entity.GetComponent<const ProjectileComponent>();
 
-                if (SDL_GetTicks() - projectile.startTime > projectile.duration) {
-                    entity.Kill();
+                    if (ticks - projectile.startTime > static_cast<Uint32>(projectile.duration)) {
+                        entity.Kill();
+                    }
                 }
-                
-            }
+            });
         }
 };
 
@@ -15,8 +15,8 @@ class RenderColliderSystem: public System {
 
         void Update(SDL_Renderer* renderer, SDL_Rect& camera) {
             for (auto entity : GetSystemEntities()) {
-                const auto transform = entity.GetComponent<TransformComponent>();
-                const auto collider = entity.GetComponent<BoxColliderComponent>();
+                const auto transform = entity.GetComponent<const TransformComponent>();
+                const auto collider = entity.GetComponent<const BoxColliderComponent>();
 
                 SDL_Rect colliderRect = {
                     static_cast<int>(transform.position.x + collider.offset.x - camera.x),
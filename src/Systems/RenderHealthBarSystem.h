@@ -19,9 +19,9 @@ class RenderHealthBarSystem: public System {
 
         void Update(SDL_Renderer* renderer, const std::unique_ptr<AssetStore>& assetStore, const SDL_Rect& camera) {
             for (auto entity : GetSystemEntities()) {
-                const auto transform = entity.GetComponent<TransformComponent>();
-                const auto sprite = entity.GetComponent<SpriteComponent>();
-                const auto health = entity.GetComponent<HealthComponent>();
+                const auto transform = entity.GetComponent<const TransformComponent>();
+                const auto sprite = entity.GetComponent<const SpriteComponent>();
+                const auto health = entity.GetComponent<const HealthComponent>();
 
                 SDL_Color healthBarColor = {255, 255, 255};
 
@@ -43,7 +43,7 @@ class RenderHealthBarSystem: public System {
                 // position health bar
                 int healthBarWidth = 15;
                 int healthBarHeight = 3;
-                double healthBarPosX = (transform.position.x + (sprite.width * transform.scale.x)) - camera.x;
+                double healthBarPosX = (transform.position.x + (sprite.data->width * transform.scale.x)) - camera.x;
                 double healthBarPosY = (transform.position.y) - camera.y;
 
                 SDL_Rect healthBarRectangle = {
@@ -15,56 +15,66 @@ class RenderSystem: public System {
             RequireComponent<SpriteComponent>();
         }
 
-        void Update(SDL_Renderer* renderer, std::unique_ptr<AssetStore>& assetStore, SDL_Rect& camera) {
-            // create a vector with both sprite and transform of all entities
+        void Update(const std::unique_ptr<Registry>& registry, SDL_Renderer* renderer, std::unique_ptr<AssetStore>& assetStore, SDL_Rect& camera) {
+            // create a vector pointing to both sprite and transform of all visible entities
             struct RenderableEntity {
-                TransformComponent transformComponent;
-                SpriteComponent spriteComponent;
+                const TransformComponent* transformComponent;
+                const SpriteComponent* spriteComponent;
             };
             std::vector<RenderableEntity> renderableEntities;
-            for (auto entity: GetSystemEntities()) {
-                RenderableEntity renderableEntity;
-                renderableEntity.spriteComponent = entity.GetComponent<SpriteComponent>();
-                renderableEntity.transformComponent = entity.GetComponent<TransformComponent>();
-
+            registry->View<const TransformComponent, const SpriteComponent>().Each([&](Entity, const TransformComponent& transform, const SpriteComponent& sprite) {
                 // bypass rendering entities if they are outside the camera view
                 bool isEntityOutsideCameraView = (
-                    renderableEntity.transformComponent.position.x + renderableEntity.transformComponent.scale.x * renderableEntity.spriteComponent.width < camera.x ||
-                    renderableEntity.transformComponent.position.x > camera.x + camera.w ||
-                    renderableEntity.transformComponent.position.y + renderableEntity.transformComponent.scale.y * renderableEntity.spriteComponent.height < camera.y || 
-                    renderableEntity.transformComponent.position.y > camera.y + camera.h
+                    transform.position.x + transform.scale.x * sprite.data->width < camera.x ||
+                    transform.position.x > camera.x + camera.w ||
+                    transform.position.y + transform.scale.y * sprite.data->height < camera.y || 
+                    transform.position.y > camera.y + camera.h
                 );
-                if (isEntityOutsideCameraView && !renderableEntity.spriteComponent.isFixed) {
-                    continue;
+                if (isEntityOutsideCameraView && !sprite.data->isFixed) {
+                    return;
                 }
-                renderableEntities.emplace_back(renderableEntity);
-            }
+                renderableEntities.push_back({&transform, &sprite});
+            });
 
-            // sort
+            // sort by z index, and inside a z index by the shared sprite data, so the entities drawing the same texture come together
             std::sort(renderableEntities.begin(), renderableEntities.end(), [](const RenderableEntity& a, const RenderableEntity& b) {
-                return a.spriteComponent.zIndex < b.spriteComponent.zIndex;
+                const int aZIndex = a.spriteComponent->data->zIndex;
+                const int bZIndex = b.spriteComponent->data->zIndex;
+                if (aZIndex != bZIndex) {
+                    return aZIndex < bZIndex;
+                }
+                return a.spriteComponent->data < b.spriteComponent->data;
             });
 
+            // the texture is only looked up when the shared sprite data changes
+            Shared<SpriteData> currentData;
+            SDL_Texture* texture = nullptr;
+
             // loop all entities that the system is interested in
-            for (auto entity : renderableEntities) {
-                // update entity position based on its velocity
-                const auto transform = entity.transformComponent;
-                const auto sprite = entity.spriteComponent;
+            for (const auto& entity : renderableEntities) {
+                const auto& transform = *entity.transformComponent;
+                const auto& sprite = *entity.spriteComponent;
+                const SpriteData& data = *sprite.data;
+
+                if (texture == nullptr || sprite.data != currentData) {
+                    currentData = sprite.data;
+                    texture = assetStore->GetTexture(data.assetId);
+                }
 
                 // set the source rectangle of original sprite texture
                 SDL_Rect srcRect = sprite.srcRect;
 
                 // set the destination rectangle with the x, y position to be rendered
                 SDL_Rect dstRect = {
-                    static_cast<int>(transform.position.x - (sprite.isFixed ? 0 : camera.x)),
-                    static_cast<int>(transform.position.y - (sprite.isFixed ? 0 : camera.y)),
-                    static_cast<int>(sprite.width * transform.scale.x),
-                    static_cast<int>(sprite.height * transform.scale.y)
+                    static_cast<int>(transform.position.x - (data.isFixed ? 0 : camera.x)),
+                    static_cast<int>(transform.position.y - (data.isFixed ? 0 : camera.y)),
+                    static_cast<int>(data.width * transform.scale.x),
+                    static_cast<int>(data.height * transform.scale.y)
                 };
 
                 SDL_RenderCopyEx(
                     renderer,
-                    assetStore->GetTexture(sprite.assetId),
+                    texture,
                     &srcRect,
                     &dstRect,
                     transform.rotation,
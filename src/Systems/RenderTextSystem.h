@@ -15,7 +15,7 @@ class RenderTextSystem: public System {
 
         void Update(SDL_Renderer* renderer, std::unique_ptr<AssetStore>& assetStore, const SDL_Rect& camera) {
             for (auto entity: GetSystemEntities()) {
-                const auto textLabel = entity.GetComponent<TextLabelComponent>();
+                const auto textLabel = entity.GetComponent<const TextLabelComponent>();
 
                 SDL_Surface* surface = TTF_RenderText_Blended(assetStore->GetFont(textLabel.assetId), textLabel.text.c_str(), textLabel.color);
 
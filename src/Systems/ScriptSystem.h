@@ -7,7 +7,7 @@
 
 std::tuple<double, double> GetEntityPosition(Entity entity) {
     if (entity.HasComponent<TransformComponent>()) {
-        const auto transform = entity.GetComponent<TransformComponent>();
+        const auto transform = entity.GetComponent<const TransformComponent>();
         return std::make_tuple(transform.position.x, transform.position.y);
     } else {
         Logger::Err("Trying to get the position of an entity that has no transform component");
@@ -17,7 +17,7 @@ std::tuple<double, double> GetEntityPosition(Entity entity) {
 
 std::tuple<double, double> GetEntityVelocity(Entity entity) {
     if (entity.HasComponent<RigidBodyComponent>()) {
-        const auto rigidbody = entity.GetComponent<RigidBodyComponent>();
+        const auto rigidbody = entity.GetComponent<const RigidBodyComponent>();
         return std::make_tuple(rigidbody.velocity.x, rigidbody.velocity.y);
     } else {
         Logger::Err("Trying to get the velocity of an entity that has no rigidbody component");
@@ -76,7 +76,10 @@ void SetProjectileVelocity(Entity entity, double x, double y) {
 class ScriptSystem: public System {
     public:
         ScriptSystem() {
-            RequireComponent<ScriptComponent>();
+            RequireComponent<ScriptComponent>(ComponentAccess::Read);
+
+            // lua scripts can read and write any component through the bindings
+            RunExclusively();
         }
 
         void CreateLuaBindings(sol::state& lua) {
@@ -85,8 +88,8 @@ class ScriptSystem: public System {
                 "entity",
                 "get_id", &Entity::GetId,
                 "destroy", &Entity::Kill,
-                "has_tag", &Entity::HasTag,
-                "belongs_to_group", &Entity::BelongsToGroup
+                "has_tag", sol::resolve<bool(const std::string&) const>(&Entity::HasTag),
+                "belongs_to_group", sol::resolve<bool(const std::string&) const>(&Entity::BelongsToGroup)
             );
             // create all the bindings between C++ and lua functions
             lua.set_function("get_position", GetEntityPosition);
@@ -100,7 +103,7 @@ class ScriptSystem: public System {
 
         void Update(double deltaTime, int ellapsedTime) {
             for (auto entity: GetSystemEntities()) {
-                const auto script = entity.GetComponent<ScriptComponent>();
+                const auto script = entity.GetComponent<const ScriptComponent>();
                 script.func(entity, deltaTime, ellapsedTime);
             }
         }
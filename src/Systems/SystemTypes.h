@@ -0,0 +1,40 @@
+#ifndef SYSTEMTYPES_H
+#define SYSTEMTYPES_H
+
+#include "../ECS/TypeList.h"
+
+class MovementSystem;
+class RenderSystem;
+class AnimationSystem;
+class CollisionSystem;
+class RenderColliderSystem;
+class DamageSystem;
+class KeyboardControlSystem;
+class CameraMovementSystem;
+class ProjectileEmitSystem;
+class ProjectileLifecycleSystem;
+class RenderTextSystem;
+class RenderHealthBarSystem;
+class RenderGUISystem;
+class ScriptSystem;
+
+// the system types of the game, the id of each one is its position in the list, known at compile time
+// a system type that is not listed still works, it gets an id after these the first time it is used
+typedef TypeList<
+    MovementSystem,
+    RenderSystem,
+    AnimationSystem,
+    CollisionSystem,
+    RenderColliderSystem,
+    DamageSystem,
+    KeyboardControlSystem,
+    CameraMovementSystem,
+    ProjectileEmitSystem,
+    ProjectileLifecycleSystem,
+    RenderTextSystem,
+    RenderHealthBarSystem,
+    RenderGUISystem,
+    ScriptSystem
+> SystemTypes;
+
+#endif
@@ -0,0 +1,107 @@
+#include "../src/ECS/ECS.h"
+#include "../src/Logger/Logger.h"
+#include "../src/Components/SpriteComponent.h"
+#include "../src/Components/TextLabelComponent.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// AddComponent constructs the component in the pool, so it must not allocate more than constructing the component itself
+// the pools allocate their storage with the aligned operator new, it is counted too, and logging is disabled
+
+static long numAllocations = 0;
+
+void* operator new(size_t size) {
+    numAllocations++;
+    void* pointer = std::malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    numAllocations++;
+    // the size of std::aligned_alloc has to be a multiple of the alignment
+    size_t align = static_cast<size_t>(alignment);
+    void* pointer = std::aligned_alloc(align, (size + align - 1) / align * align);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+template <typename TFunc>
+long CountAllocations(TFunc&& func) {
+    long before = numAllocations;
+    func();
+    return numAllocations - before;
+}
+
+static int numFailures = 0;
+
+void Check(const char* name, long addAllocations, long constructAllocations) {
+    bool isOk = addAllocations <= constructAllocations;
+    fprintf(stderr, "%s %s: %ld allocations per AddComponent, %ld to construct the component\n", isOk ? "ok  " : "FAIL", name, addAllocations, constructAllocations);
+    if (!isOk) {
+        numFailures++;
+    }
+}
+
+template <typename TComponent, typename ...TArgs>
+long CountAddAllocations(Entity entity, TArgs&& ...args) {
+    return CountAllocations([&]() {
+        entity.AddComponent<TComponent>(std::forward<TArgs>(args)...);
+    });
+}
+
+int main() {
+    Logger::isEnabled = false;
+
+    Registry registry;
+    std::vector<Entity> entities;
+    for (int i = 0; i < 2000; i++) {
+        entities.push_back(registry.CreateEntity());
+    }
+
+    // grow the pools and their entity index up front, so the adds below do not reallocate them
+    for (int i = 1000; i < 2000; i++) {
+        entities[i].AddComponent<SpriteComponent>("tank-tiger-right-texture", 32, 32, 2);
+        entities[i].AddComponent<TextLabelComponent>(glm::vec2(0), "a label that does not fit a small string", "charriot-font");
+    }
+
+    Entity entity = entities[500];
+    const std::string assetId = "tank-tiger-right-texture";
+    const std::string text = "a label that does not fit a small string";
+
+    // the sprite data is interned already, by the adds above
+    long constructAllocations = CountAllocations([&]() { SpriteComponent sprite(assetId, 32, 32, 2); });
+    Check("SpriteComponent", CountAddAllocations<SpriteComponent>(entity, assetId, 32, 32, 2), constructAllocations);
+    constructAllocations = CountAllocations([&]() { SpriteComponent sprite(assetId, 32, 32, 2, false, 32, 0); });
+    Check("SpriteComponent replaced", CountAddAllocations<SpriteComponent>(entity, assetId, 32, 32, 2, false, 32, 0), constructAllocations);
+
+    constructAllocations = CountAllocations([&]() { TextLabelComponent label(glm::vec2(0), text, "charriot-font"); });
+    Check("TextLabelComponent", CountAddAllocations<TextLabelComponent>(entity, glm::vec2(0), text, "charriot-font"), constructAllocations);
+    constructAllocations = CountAllocations([&]() { TextLabelComponent label(glm::vec2(10), text, "charriot-font"); });
+    Check("TextLabelComponent replaced", CountAddAllocations<TextLabelComponent>(entity, glm::vec2(10), text, "charriot-font"), constructAllocations);
+
+    return numFailures == 0 ? 0 : 1;
+}
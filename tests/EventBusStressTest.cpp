@@ -0,0 +1,103 @@
+#include "../src/EventBus/EventBus.h"
+#include "../src/EventBus/Event.h"
+#include <cstdio>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// 8 producer threads enqueue a million events, the main thread dispatches them at the sync point:
+// every event arrives once, the events of a producer arrive in the order it enqueued them,
+// and with an event order set the dispatch order is the same on every run
+
+const int NUM_PRODUCERS = 8;
+const int EVENTS_PER_PRODUCER = 125000;
+
+class StressEvent: public Event {
+    public:
+        int producer;
+        int sequence;
+        StressEvent(int producer, int sequence): producer(producer), sequence(sequence) {}
+};
+
+class StressHandler {
+    public:
+        long numEvents = 0;
+        long numOutOfOrder = 0;
+        std::vector<int> nextSequences;
+        std::vector<std::pair<int, int>> dispatchOrder;
+
+        void OnEvents(const std::vector<StressEvent>& events) {
+            for (const auto& event : events) {
+                if (event.sequence != nextSequences[event.producer]) {
+                    numOutOfOrder++;
+                }
+                nextSequences[event.producer] = event.sequence + 1;
+                dispatchOrder.push_back({event.producer, event.sequence});
+                numEvents++;
+            }
+        }
+};
+
+void Produce(EventBus& eventBus, int eventsPerProducer) {
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < NUM_PRODUCERS; producer++) {
+        producers.emplace_back([&eventBus, producer, eventsPerProducer]() {
+            for (int sequence = 0; sequence < eventsPerProducer; sequence++) {
+                eventBus.Enqueue<StressEvent>(producer, sequence);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+}
+
+static int numFailures = 0;
+
+void Check(const char* name, bool isOk) {
+    fprintf(stderr, "%s %s\n", isOk ? "ok  " : "FAIL", name);
+    if (!isOk) {
+        numFailures++;
+    }
+}
+
+int main() {
+    EventBus eventBus;
+    StressHandler handler;
+    eventBus.SubscribeToEventBatch<StressEvent>(&handler, &StressHandler::OnEvents);
+
+    // the buffers of the threads are reused by the second round
+    for (int round = 0; round < 2; round++) {
+        handler.numEvents = 0;
+        handler.numOutOfOrder = 0;
+        handler.nextSequences.assign(NUM_PRODUCERS, 0);
+        handler.dispatchOrder.clear();
+
+        Produce(eventBus, EVENTS_PER_PRODUCER);
+        eventBus.DispatchQueuedEvents();
+
+        Check("every event is dispatched once", handler.numEvents == static_cast<long>(NUM_PRODUCERS) * EVENTS_PER_PRODUCER);
+        Check("the events of a producer are dispatched in order", handler.numOutOfOrder == 0);
+    }
+
+    // with an order set, the dispatch does not depend on how the producer threads interleaved
+    eventBus.SetEventOrder<StressEvent>([](const StressEvent& a, const StressEvent& b) {
+        if (a.producer != b.producer) {
+            return a.producer < b.producer;
+        }
+        return a.sequence < b.sequence;
+    });
+    std::vector<std::vector<std::pair<int, int>>> runs;
+    for (int run = 0; run < 3; run++) {
+        handler.nextSequences.assign(NUM_PRODUCERS, 0);
+        handler.dispatchOrder.clear();
+
+        Produce(eventBus, 1000);
+        eventBus.DispatchQueuedEvents();
+        runs.push_back(handler.dispatchOrder);
+    }
+    Check("the ordered dispatch is the same on every run", runs[0] == runs[1] && runs[1] == runs[2]);
+    Check("the ordered dispatch follows the event order", runs[0].size() == NUM_PRODUCERS * 1000 && runs[0].front() == std::make_pair(0, 0) && runs[0].back() == std::make_pair(NUM_PRODUCERS - 1, 999));
+
+    return numFailures == 0 ? 0 : 1;
+}